@@ -0,0 +1,91 @@
+#include <expr.h>
+#include <expr_opt.h>
+#include <expr_vm.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kRows = 1 << 16;
+constexpr int kRounds = 50;
+constexpr size_t kVars = 3;
+
+const char* const kExprs[] = {
+    "a*b + c",
+    "a*b + c - (a - b) * 3 + a % 7",
+    "(a + b) * (a - b) / (c % 1000 + 1001) + powmod(a, 65537, 1000000007)",
+    "a * (60*60*24) + c / pow(2,10) + (a*b) % 16 - (a*b) / 8",
+};
+
+std::vector<std::int64_t> make_rows()
+{
+    std::mt19937_64 rng(42);
+    std::vector<std::int64_t> rows(kRows * kVars);
+    for (std::int64_t& v : rows) {
+        v = static_cast<std::int64_t>(rng() % 2000000001) - 1000000000;
+    }
+    return rows;
+}
+
+template <typename Eval>
+double bench(const char* name, const std::vector<std::int64_t>& rows, Eval eval)
+{
+    std::int64_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+        for (size_t i = 0; i < kRows; ++i) {
+            const eval_result v = eval(&rows[i * kVars]);
+            sum += v.error == eval_error::none ? v.value : 1;
+        }
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    const double ns = elapsed.count() / (static_cast<double>(kRows) * kRounds);
+    std::printf("  %-9s %7.2f ns/row  (checksum %lld)\n", name, ns, static_cast<long long>(sum));
+    return ns;
+}
+
+} // namespace
+
+int main()
+{
+    const std::vector<std::int64_t> rows = make_rows();
+    const std::vector<std::string> names = { "a", "b", "c" };
+
+    for (const char* s : kExprs) {
+        expr_tree t;
+        expr_tree opt;
+        expr_parse_error err;
+        expr_program p;
+        expr_program po;
+        if (!parse_expr(s, std::strlen(s), names, &t, &err)) {
+            std::fprintf(stderr, "cannot parse '%s'\n", s);
+            return 1;
+        }
+        optimize_expr(t, &opt);
+        if (!compile_expr(t, kVars, &p) || !compile_expr(opt, kVars, &po)) {
+            std::fprintf(stderr, "cannot compile '%s'\n", s);
+            return 1;
+        }
+        std::vector<std::int64_t> regs = p.init;
+        std::vector<std::int64_t> oregs = po.init;
+
+        std::printf("%s (%zu instructions, %zu optimized)\n", s, p.code.size(), po.code.size());
+        const double ast = bench("ast", rows, [&](const std::int64_t* vars) { return eval_expr(t, vars); });
+        const double vm = bench("bytecode", rows, [&](const std::int64_t* vars) {
+            std::memcpy(regs.data(), vars, kVars * sizeof(std::int64_t));
+            return run_expr_program(p, regs.data());
+        });
+        const double ovm = bench("optimized", rows, [&](const std::int64_t* vars) {
+            std::memcpy(oregs.data(), vars, kVars * sizeof(std::int64_t));
+            return run_expr_program(po, oregs.data());
+        });
+        std::printf("  speedup  %7.2fx, %.2fx optimized\n", ast / vm, ast / ovm);
+    }
+    return 0;
+}
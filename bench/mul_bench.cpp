@@ -0,0 +1,122 @@
+#include <bigint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMinLimbs = 8;
+constexpr size_t kMaxLimbs = 8192;
+// Each measurement repeats until at least this much time has passed.
+constexpr double kMinSampleNs = 20e6;
+// A crossover is accepted once the faster algorithm has won by kMargin at
+// kStreak consecutive sizes, so that one noisy sample cannot move it.
+constexpr double kMargin = 0.05;
+constexpr size_t kStreak = 3;
+
+bigint random_bigint(std::mt19937_64& rng, size_t limbs)
+{
+    std::vector<bigint::limb> v(limbs);
+    for (bigint::limb& l : v) {
+        l = rng();
+    }
+    v.back() |= bigint::limb { 1 } << 63;
+    return bigint::from_limbs(v.data(), v.size());
+}
+
+double time_mul(const bigint& a, const bigint& b, mul_algorithm algo)
+{
+    using clock = std::chrono::steady_clock;
+    size_t reps = 0;
+    bool sink = false;
+    const auto start = clock::now();
+    std::chrono::duration<double, std::nano> elapsed {};
+    do {
+        const bigint r = mul_with(a, b, algo);
+        sink ^= r.is_zero();
+        ++reps;
+        elapsed = clock::now() - start;
+    } while (elapsed.count() < kMinSampleNs);
+    if (sink) {
+        std::printf("?");
+    }
+    return elapsed.count() / static_cast<double>(reps);
+}
+
+// The first size of the first winning streak, or kMaxLimbs + 1 if the
+// faster algorithm never wins one.
+class crossover {
+public:
+    void record(size_t n, double faster, double slower)
+    {
+        if (at_ != 0) {
+            return;
+        }
+        if (faster > slower * (1 - kMargin)) {
+            streak_ = 0;
+            return;
+        }
+        if (streak_++ == 0) {
+            start_ = n;
+        }
+        if (streak_ == kStreak) {
+            at_ = start_;
+        }
+    }
+
+    size_t at() const
+    {
+        return at_ != 0 ? at_ : kMaxLimbs + 1;
+    }
+
+private:
+    size_t at_ = 0;
+    size_t start_ = 0;
+    size_t streak_ = 0;
+};
+
+// Sizes grow by an eighth, with kMaxLimbs itself as the last one.
+size_t next_size(size_t n)
+{
+    return n < kMaxLimbs ? std::min(n + n / 8, kMaxLimbs) : kMaxLimbs + 1;
+}
+
+} // namespace
+
+int main()
+{
+    std::mt19937_64 rng(1);
+
+    crossover karatsuba;
+    crossover toom3;
+    crossover ntt;
+    std::printf("%8s %14s %14s %14s %14s\n", "limbs", "basecase ns", "karatsuba ns", "toom3 ns", "ntt ns");
+    for (size_t n = kMinLimbs; n <= kMaxLimbs; n = next_size(n)) {
+        const bigint a = random_bigint(rng, n);
+        const bigint b = random_bigint(rng, n);
+        const double base_ns = time_mul(a, b, mul_algorithm::basecase);
+        const double kara_ns = time_mul(a, b, mul_algorithm::karatsuba);
+        const double toom_ns = time_mul(a, b, mul_algorithm::toom3);
+        const double ntt_ns = time_mul(a, b, mul_algorithm::ntt);
+        std::printf("%8zu %14.0f %14.0f %14.0f %14.0f\n", n, base_ns, kara_ns, toom_ns, ntt_ns);
+
+        karatsuba.record(n, kara_ns, base_ns);
+        toom3.record(n, toom_ns, kara_ns);
+        ntt.record(n, ntt_ns, std::min(kara_ns, toom_ns));
+    }
+
+    // Each algorithm is used from its threshold up to the next one, so the
+    // thresholds must increase. The NTT crossover is measured against the
+    // better of the other two; a Toom-3 one at or above it is moved just
+    // below it, leaving Karatsuba in use up to the NTT.
+    const size_t karatsuba_at = karatsuba.at();
+    const size_t ntt_at = std::max(ntt.at(), karatsuba_at + 2);
+    const size_t toom3_at = std::clamp(toom3.at(), karatsuba_at + 1, ntt_at - 1);
+    std::printf("\nsuggested: -DCALC_KARATSUBA_THRESHOLD=%zu -DCALC_TOOM3_THRESHOLD=%zu -DCALC_NTT_THRESHOLD=%zu\n",
+        karatsuba_at, toom3_at, ntt_at);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <calc.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kInputs = 1 << 16;
+constexpr int kRounds = 50;
+
+// The strtoll-based parser parse_i64() replaced, kept as the baseline.
+bool parse_i64_strtoll(const char* s, std::int64_t* out)
+{
+    errno = 0;
+    char* end = nullptr;
+    long long v = std::strtoll(s, &end, 10);
+    if (end == s || *end != '\0' || errno == ERANGE) {
+        return false;
+    }
+    *out = static_cast<std::int64_t>(v);
+    return true;
+}
+
+std::vector<std::string> make_inputs()
+{
+    std::mt19937_64 rng(42);
+    std::vector<std::string> inputs;
+    inputs.reserve(kInputs);
+    for (size_t i = 0; i < kInputs; ++i) {
+        // Uniform over digit counts rather than values, so short numbers
+        // (the common case in practice) are represented.
+        const auto digits = static_cast<int>(rng() % 19) + 1;
+        std::uint64_t v = rng();
+        std::uint64_t bound = 1;
+        for (int d = 0; d < digits; ++d) {
+            bound *= 10;
+        }
+        v %= bound;
+        std::string s = (rng() & 1) != 0 ? "-" : "";
+        s += std::to_string(v);
+        inputs.push_back(s);
+    }
+    return inputs;
+}
+
+template <typename Parser>
+double bench(const char* name, const std::vector<std::string>& inputs, Parser parse)
+{
+    std::int64_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+        for (const std::string& s : inputs) {
+            std::int64_t v = 0;
+            if (parse(s.c_str(), &v)) {
+                sum += v;
+            }
+        }
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    const double ns = elapsed.count() / (static_cast<double>(inputs.size()) * kRounds);
+    std::printf("%-10s %7.2f ns/op  (checksum %lld)\n", name, ns, static_cast<long long>(sum));
+    return ns;
+}
+
+} // namespace
+
+int main()
+{
+    const std::vector<std::string> inputs = make_inputs();
+
+    for (const std::string& s : inputs) {
+        std::int64_t a = 0;
+        std::int64_t b = 0;
+        if (parse_i64(s.c_str(), &a) != parse_i64_strtoll(s.c_str(), &b) || a != b) {
+            std::fprintf(stderr, "mismatch on '%s'\n", s.c_str());
+            return 1;
+        }
+    }
+
+    const double base = bench("strtoll", inputs, parse_i64_strtoll);
+    const double fast = bench("parse_i64", inputs, [](const char* s, std::int64_t* v) { return parse_i64(s, v); });
+    std::printf("speedup    %7.2fx\n", base / fast);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <calc.h>
+#include <output.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Binary records are fixed-width and little-endian:
+//   request  (17 bytes): op:u8 (operation value), a:i64, b:i64 (ignored by
+//                        fact and isprime)
+//   response (10 bytes): kind:u8 (wire_kind), error:u8 (wire_error), value:i64/u64
+// Only add..fact, mod, isprime, primecount and binom fit a record; other
+// operations are answered with wire_error::bad_op.
+constexpr size_t kRecordInSize = 17;
+constexpr size_t kRecordOutSize = 10;
+
+// A single result under --output raw is one variable-length record:
+//   kind:u8 (wire_kind), error:u8 (wire_error), sign:u8 (1 if negative),
+//   size:u64, then `size` bytes of value. i64/u64 values take 8 bytes as in
+//   binary responses; big values are their magnitude, little-endian. Failed
+//   results have size 0.
+constexpr size_t kRawHeaderSize = 11;
+
+enum class wire_kind : std::uint8_t {
+    i64 = 0,
+    u64 = 1,
+    big = 2
+};
+
+enum class wire_error : std::uint8_t {
+    ok = 0,
+    div0 = 1,
+    overflow = 2,
+    math = 3,
+    bad_op = 4,
+    domain = 5
+};
+
+wire_error to_wire(mathlib::ml_error e);
+
+struct batch_options {
+    // Values above 1 evaluate input windows on a work-stealing worker pool;
+    // results are still written in input order.
+    unsigned threads = 1;
+    // Print per-worker scheduler statistics to stderr when done.
+    bool stats = false;
+    // Text input only: evaluate with arbitrary-precision operands.
+    bool bigint = false;
+};
+
+// Evaluates "<op> <a> [<b>]" lines from `in` and writes exactly one line per
+// input line to `out`: the result, or "error: <reason>". Per-line failures are
+// reported in-band; the return value only reflects I/O failures.
+exit_code run_batch(std::FILE* in, out_buffer& out, const batch_options& o);
+
+// Same as run_batch() for binary records. A trailing partial record is a usage
+// error; everything before it is still answered.
+exit_code run_batch_binary(std::FILE* in, out_buffer& out, const batch_options& o);
+
+// Same as run_batch()/run_batch_binary() over an in-memory buffer, typically a
+// mapped file; lines and records are evaluated in place without copying.
+exit_code run_batch_buffer(const char* data, size_t size, out_buffer& out, const batch_options& o);
+exit_code run_batch_binary_buffer(const char* data, size_t size, out_buffer& out, const batch_options& o);
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Growable limb array that keeps up to kInline limbs inside the object, so
+// values of up to 128 bits never touch the heap.
+class limb_vector {
+public:
+    using limb = std::uint64_t;
+    static constexpr std::uint32_t kInline = 2;
+
+    limb_vector() = default;
+    limb_vector(const limb_vector& other);
+    limb_vector(limb_vector&& other) noexcept;
+    limb_vector& operator=(const limb_vector& other);
+    limb_vector& operator=(limb_vector&& other) noexcept;
+    ~limb_vector();
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    limb* data() { return heap() ? heap_ : inline_; }
+    const limb* data() const { return heap() ? heap_ : inline_; }
+    limb& operator[](size_t i) { return data()[i]; }
+    limb operator[](size_t i) const { return data()[i]; }
+    limb back() const { return data()[size_ - 1]; }
+
+    void clear() { size_ = 0; }
+    void reserve(size_t n);
+    // New limbs are zero.
+    void resize(size_t n);
+    void push_back(limb v);
+    void pop_back() { --size_; }
+    // Inserts n zero limbs at the low end (a left shift by 64 * n bits).
+    void insert_low(size_t n);
+
+private:
+    bool heap() const { return cap_ > kInline; }
+
+    union {
+        limb inline_[kInline];
+        limb* heap_;
+    };
+    std::uint32_t size_ = 0;
+    std::uint32_t cap_ = kInline;
+};
+
+enum class mul_algorithm : std::uint8_t {
+    automatic,
+    basecase,
+    karatsuba,
+    toom3,
+    ntt
+};
+
+// Arbitrary-precision signed integer: sign and magnitude, the magnitude as
+// little-endian 64-bit limbs without leading zero limbs (zero has no limbs
+// and is never negative).
+class bigint {
+public:
+    using limb = std::uint64_t;
+
+    bigint() = default;
+    explicit bigint(std::int64_t v);
+    static bigint from_u64(std::uint64_t v);
+    // Non-negative value of the little-endian limbs p[0..n).
+    static bigint from_limbs(const limb* p, size_t n);
+
+    // Same syntax as parse_i64(): optional leading whitespace, an optional
+    // sign and at least one decimal digit, with no upper bound on length.
+    static bool parse(const char* s, size_t n, bigint* out);
+
+    bool is_zero() const { return mag_.empty(); }
+    bool is_negative() const { return neg_; }
+    size_t size() const { return mag_.size(); }
+    const limb* data() const { return mag_.data(); }
+
+    // True if the value fits; *out is left alone otherwise.
+    bool to_u64(std::uint64_t* out) const;
+    size_t bit_length() const;
+
+    bigint operator-() const;
+    bigint& operator*=(std::uint64_t m);
+    bigint& operator<<=(std::uint64_t bits);
+    friend bigint operator+(const bigint& x, const bigint& y);
+    friend bigint operator-(const bigint& x, const bigint& y);
+    friend bigint operator*(const bigint& x, const bigint& y);
+
+    // Multiplies with `top` at the top level only; recursive products use the
+    // configured thresholds. Used to calibrate those thresholds. Products
+    // too long for a single NTT fall back to the automatic choice.
+    friend bigint mul_with(const bigint& x, const bigint& y, mul_algorithm top);
+    friend bool operator==(const bigint& x, const bigint& y);
+
+    // Truncating division like the built-in operators: the quotient rounds
+    // toward zero and the remainder takes the sign of x. Returns false when
+    // y is zero.
+    friend bool divmod(const bigint& x, const bigint& y, bigint* q, bigint* r);
+
+    std::string to_string() const;
+    // Lowercase base 16 without prefix, e.g. "-ff"; linear time.
+    std::string to_hex() const;
+
+private:
+    void trim();
+
+    limb_vector mag_;
+    bool neg_ = false;
+};
+
+// Exact n!, via the prime-swing recursion on the odd part of n! with a
+// balanced product tree; the power of two is applied as a single shift.
+// false if the result would exceed kMaxBigintBits.
+bool factorial(std::uint64_t n, bigint* out);
+
+// Exact C(n, k), 0 for k > n: from the prime factorization by Legendre's
+// formula, or for min(k, n - k) much smaller than n as a falling factorial
+// over k!; false if the result, or that falling factorial, would exceed
+// kMaxBigintBits.
+bool binomial(std::uint64_t n, std::uint64_t k, bigint* out);
+
+// Exact x^e by sliding-window exponentiation on the odd part of x, with the
+// power of two applied as one shift; false if the result would exceed
+// kMaxBigintBits.
+bool pow(const bigint& x, std::uint64_t e, bigint* out);
+
+// x^e mod m in [0, m), with Montgomery multiplication for odd m and Barrett
+// reduction otherwise; false unless e >= 0 and m > 0.
+bool powmod(const bigint& x, const bigint& e, const bigint& m, bigint* out);
+
+// Results larger than this are reported as overflow instead of attempted.
+constexpr std::uint64_t kMaxBigintBits = std::uint64_t { 1 } << 36;
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <bigint.h>
+#include <mathlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum class operation : std::uint8_t {
+    none = 0,
+    add,
+    sub,
+    mul,
+    div,
+    pow,
+    fact,
+    bigmul,
+    mod,
+    divmod,
+    bigpow,
+    powmod,
+    isprime,
+    factor,
+    primecount,
+    primes,
+    binom
+};
+
+enum class exit_code : std::uint8_t {
+    ok = 0,
+    usage = 1,
+    math = 2
+};
+
+enum class check_error : std::uint8_t {
+    none = 0,
+    missing_operand,
+    useless_b,
+    missing_b,
+    pow_domain,
+    fact_domain,
+    missing_m,
+    useless_m,
+    powmod_domain,
+    factor_domain,
+    sieve_domain,
+    binom_domain
+};
+
+struct context {
+    operation op = operation::none;
+    bool have_op = false;
+
+    std::int64_t a = 0;
+    bool have_a = false;
+
+    std::int64_t b = 0;
+    bool have_b = false;
+
+    // Modulus, powmod only.
+    std::int64_t m = 0;
+    bool have_m = false;
+
+    mathlib::ml_result r {};
+    // divmod only: the remainder, with r holding the quotient and any error.
+    mathlib::ml_result r2 {};
+
+    // With big set (--bigint) the operands and result live in big_a, big_b,
+    // big_m and big_r; r only carries the error.
+    bool big = false;
+    bigint big_a;
+    bigint big_b;
+    bigint big_m;
+    bigint big_r;
+    bigint big_r2;
+
+    // factor only: the prime factors in ascending order, with r carrying any
+    // error, in both modes.
+    std::vector<std::uint64_t> factors;
+
+    // primecount/primes: threads to sieve on.
+    unsigned threads = 1;
+};
+
+struct op_spec {
+    const char* name;
+    operation op;
+};
+
+constexpr op_spec kOps[] = {
+    { "add", operation::add },
+    { "sub", operation::sub },
+    { "mul", operation::mul },
+    { "div", operation::div },
+    { "pow", operation::pow },
+    { "fact", operation::fact },
+    { "bigmul", operation::bigmul },
+    { "mod", operation::mod },
+    { "divmod", operation::divmod },
+    { "bigpow", operation::bigpow },
+    { "powmod", operation::powmod },
+    { "isprime", operation::isprime },
+    { "factor", operation::factor },
+    { "primecount", operation::primecount },
+    { "primes", operation::primes },
+    { "binom", operation::binom },
+};
+
+constexpr size_t kOpsCount = sizeof(kOps) / sizeof(kOps[0]);
+
+bool needs_b(operation op);
+bool needs_m(operation op);
+
+// Operations that always use bigint operands, with or without --bigint.
+bool is_big_op(operation op);
+
+// Accepts exactly what strtoll(s, &end, 10) accepts with *end == '\0' and no
+// ERANGE: optional leading whitespace, an optional sign and at least one
+// decimal digit, within [INT64_MIN, INT64_MAX].
+bool parse_i64(const char* s, std::int64_t* out);
+bool parse_op(const char* s, operation* out);
+
+// Variants for tokens that are not NUL-terminated (e.g. inside a mapped file);
+// all n bytes must form the integer.
+bool parse_i64(const char* s, size_t n, std::int64_t* out);
+bool parse_op(const char* s, size_t n, operation* out);
+
+// Same rules as the command line, without printing anything, so that every
+// front-end rejects exactly the same inputs.
+check_error validate(const context& c);
+
+const char* math_err_str(mathlib::ml_error e);
+
+// binom without --bigint: C(n, k) or overflow, 0 when k > n.
+mathlib::ml_result binom_i64(std::uint64_t n, std::uint64_t k);
+
+// primecount/primes: [a, b] as unsigned bounds; false unless
+// 0 <= a <= b <= kSieveMax.
+bool sieve_range(const context& c, std::uint64_t* a, std::uint64_t* b);
+
+// primes has no single result: front ends stream it with write_primes()
+// instead.
+exit_code calc(context& c);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <calc.h>
+#include <modarith.h>
+#include <output.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Column-at-a-time evaluation of add/sub/mul on int64 arrays. Kernels are
+// picked at runtime (AVX-512, AVX2, scalar). powmod is evaluated per modulus
+// group instead.
+//
+// Binary columnar input is two little-endian int64 columns of equal length,
+// all of a followed by all of b (and, for powmod, all of m). Output is the
+// result column followed by the overflow bitmap: ceil(n / 64) little-endian
+// u64 words, bit i % 64 of word i / 64 set when lane i overflowed, or for
+// powmod when it is outside the domain. Such lanes hold 0.
+
+bool columnar_supported(operation op);
+
+// Name of the kernel set columnar_eval() dispatches to on this machine.
+const char* columnar_isa();
+
+// Lane i overflows exactly when the matching mathlib::ml_add/ml_sub/ml_mul
+// call reports ml_error::overflow. `overflow` must hold ceil(n / 64) words.
+void columnar_eval(operation op, const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t n);
+
+// out[i] = a[i]^b[i] mod m[i] in [0, m[i]); lanes with b < 0 or m <= 0 set
+// their bit in `error`, which must hold ceil(n / 64) words. Lanes are sorted
+// by modulus so that each group looks up its constants in `cache` once.
+void columnar_powmod(const std::int64_t* a, const std::int64_t* b, const std::int64_t* m, std::int64_t* out,
+    std::uint64_t* error, size_t n, modulus_cache& cache);
+
+// Number of input columns -o op takes: 3 for powmod, 2 otherwise.
+size_t columnar_columns(operation op);
+
+exit_code run_columnar(operation op, const char* data, size_t size, out_buffer& out);
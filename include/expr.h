@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Integer expressions such as "(2+3)*7^4 - 5!". A tokenizer and a Pratt
+// parser build an AST over int64 values, evaluated with the rules of the
+// matching single operations: every overflow, division by zero and domain
+// error is caught and located at the operator that raised it.
+//
+// Precedence, loosest first: + -, then * / % (all left-associative), unary
+// -, ^ (right-associative), postfix ! (factorial). Functions: pow(a, b),
+// fact(a), binom(n, k), powmod(a, b, m).
+
+enum class expr_kind : std::uint8_t {
+    literal,
+    variable,
+    neg,
+    add,
+    sub,
+    mul,
+    div,
+    mod,
+    pow,
+    fact,
+    binom,
+    powmod,
+    // Produced by optimize_expr() only. shl, div_pow2 and mod_pow2 are
+    // x * 2^k, x / 2^k and x % 2^k with x and k as operands; fail raises
+    // the error in value where a constant subexpression would have.
+    shl,
+    div_pow2,
+    mod_pow2,
+    fail
+};
+
+// Nodes live in one array and refer to their operands by index; operands
+// always come before the nodes that use them.
+struct expr_node {
+    expr_kind kind = expr_kind::literal;
+    // Byte offset of the operator, function name, literal or variable.
+    std::uint32_t pos = 0;
+    std::uint32_t args[3] = {};
+    // literal: the value; variable: its index; fail: the eval_error.
+    std::int64_t value = 0;
+};
+
+struct expr_tree {
+    std::vector<expr_node> nodes;
+    std::uint32_t root = 0;
+};
+
+struct expr_parse_error {
+    std::string message;
+    size_t pos = 0;
+};
+
+enum class eval_error : std::uint8_t {
+    none = 0,
+    div0,
+    overflow,
+    domain
+};
+
+struct eval_result {
+    std::int64_t value = 0;
+    eval_error error = eval_error::none;
+    // On error: byte offset of the node that failed.
+    std::uint32_t pos = 0;
+};
+
+size_t expr_arity(expr_kind k);
+
+// A letter or '_' followed by letters, digits and '_'.
+bool is_expr_name(const char* s, size_t n);
+
+// Names in vars may be used as variables and are bound by index when the
+// expression is evaluated.
+bool parse_expr(const char* s, size_t n, const std::vector<std::string>& vars, expr_tree* out, expr_parse_error* err);
+
+// One operator node applied to its operand values (unused ones are ignored).
+eval_error apply_expr_op(expr_kind k, std::int64_t a, std::int64_t b, std::int64_t c, std::int64_t* out);
+
+// a / 2^k for 1 <= k <= 62, truncating like '/': an arithmetic shift rounds
+// towards -inf, so negative dividends get 2^k - 1 added first.
+inline std::int64_t shift_div(std::int64_t a, std::int64_t k)
+{
+    const auto bias = static_cast<std::int64_t>(static_cast<std::uint64_t>(a >> 63) >> (64 - k));
+    return (a + bias) >> k;
+}
+
+// vars holds one value per name given to parse_expr().
+eval_result eval_expr(const expr_tree& t, const std::int64_t* vars);
+
+const char* eval_err_str(eval_error e);
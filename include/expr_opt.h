@@ -0,0 +1,16 @@
+#pragma once
+
+#include <expr.h>
+
+// Rewrites an expression tree for repeated evaluation without changing any
+// result, error or error position:
+//  - subexpressions whose operands are all constant are folded; one that
+//    fails becomes a fail node at the same point of the evaluation order,
+//    so an overflowing constant still reports overflow where it did;
+//  - multiplication, division and remainder by 2^k become shifts, x^2
+//    becomes x * x, and + 0, - 0, * 1, / 1, ^ 1 disappear;
+//  - equal subexpressions are evaluated once (operands of + and * in either
+//    order count as equal).
+// Subtrees are only dropped when they cannot fail, so the first error a row
+// hits is the same as in the original tree.
+void optimize_expr(const expr_tree& in, expr_tree* out);
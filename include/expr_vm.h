@@ -0,0 +1,71 @@
+#pragma once
+
+#include <calc.h>
+#include <expr.h>
+#include <output.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Register bytecode for expressions applied to many rows: the tree is
+// compiled once and every row runs a flat instruction array over a small
+// register file, instead of walking the AST.
+//
+// Registers hold the row's variables first, then the constants (loaded once
+// per program), then temporaries reused as soon as their value is dead.
+
+enum class expr_opcode : std::uint8_t {
+    neg,
+    add,
+    sub,
+    mul,
+    div,
+    mod,
+    pow,
+    fact,
+    binom,
+    powmod,
+    shl,
+    div_pow2,
+    mod_pow2,
+    // Raises eval_error a.
+    fail,
+    // Ends the program with register a as the result.
+    ret
+};
+
+// Three-address form: dst = op(a, b, c), with operands a op needs unused.
+struct expr_instr {
+    expr_opcode op;
+    std::uint16_t dst;
+    std::uint16_t a;
+    std::uint16_t b;
+    std::uint16_t c;
+};
+
+struct expr_program {
+    std::vector<expr_instr> code;
+    // Source offset of each instruction, for error positions.
+    std::vector<std::uint32_t> pos;
+    // Register file each row starts from: zeros for the variables and the
+    // temporaries, the constants in between.
+    std::vector<std::int64_t> init;
+    size_t vars = 0;
+};
+
+constexpr size_t kMaxExprRegisters = size_t { 1 } << 16;
+
+// False when the expression needs more than kMaxExprRegisters registers.
+bool compile_expr(const expr_tree& t, size_t vars, expr_program* out);
+
+// regs starts as a copy of p.init with the row's values in the first p.vars
+// registers; the variables and constants are left as they were, so the
+// same file can be reused for the next row after storing its values.
+eval_result run_expr_program(const expr_program& p, std::int64_t* regs);
+
+// One row per text line, p.vars whitespace-separated integers in --vars
+// order, printing the result or "error: <reason>" per line; or, with
+// binary, records of p.vars little-endian int64 values answered with the
+// 10-byte --binary output records.
+exit_code run_expr_rows(const expr_program& p, const char* data, size_t size, bool binary, out_buffer& out);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only private mapping of a whole file, advised for sequential access.
+// An empty file maps to a null pointer with size 0.
+class mapped_file {
+public:
+    mapped_file() = default;
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    // Returns false and leaves errno set on failure.
+    bool open(const char* path);
+
+    const char* data() const { return static_cast<const char*>(addr_); }
+    size_t size() const { return size_; }
+
+private:
+    void* addr_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Arithmetic modulo a 64-bit m with 128-bit intermediates and no division
+// on the hot path. Residues are always in [0, m).
+
+// Montgomery form modulo an odd m: x is held as x R mod m with R = 2^64, and
+// a product is reduced with two more multiplications instead of a division.
+class montgomery64 {
+public:
+    __extension__ using u128 = unsigned __int128;
+
+    explicit montgomery64(std::uint64_t m);
+
+    std::uint64_t modulus() const { return m_; }
+    // 1 in Montgomery form.
+    std::uint64_t one() const { return one_; }
+
+    std::uint64_t to(std::uint64_t x) const { return mul(x % m_, r2_); }
+    std::uint64_t from(std::uint64_t x) const { return reduce(x); }
+
+    std::uint64_t mul(std::uint64_t a, std::uint64_t b) const { return reduce(static_cast<u128>(a) * b); }
+
+    std::uint64_t add(std::uint64_t a, std::uint64_t b) const
+    {
+        const std::uint64_t s = a + b;
+        return s < a || s >= m_ ? s - m_ : s;
+    }
+
+    std::uint64_t sub(std::uint64_t a, std::uint64_t b) const { return a >= b ? a - b : a - b + m_; }
+
+    // x^e with x and the result in Montgomery form.
+    std::uint64_t pow(std::uint64_t x, std::uint64_t e) const;
+
+private:
+    // t R^-1 mod m for t < m R: q = t m^-1 mod R makes t - q m divisible by R.
+    std::uint64_t reduce(u128 t) const
+    {
+        const std::uint64_t q = static_cast<std::uint64_t>(t) * inv_;
+        const auto h = static_cast<std::uint64_t>((static_cast<u128>(q) * m_) >> 64);
+        const auto hi = static_cast<std::uint64_t>(t >> 64);
+        return hi >= h ? hi - h : hi - h + m_;
+    }
+
+    std::uint64_t m_;
+    std::uint64_t inv_; // m^-1 mod 2^64
+    std::uint64_t one_; // R mod m
+    std::uint64_t r2_; // R^2 mod m
+};
+
+// Barrett reduction modulo any m >= 1: with mu = floor((2^128 - 1) / m), the
+// quotient of x < 2^128 is estimated from the high half of x mu and is at
+// most two too small.
+class barrett64 {
+public:
+    __extension__ using u128 = unsigned __int128;
+
+    explicit barrett64(std::uint64_t m)
+        : m_(m)
+        , mu_(~static_cast<u128>(0) / m)
+    {
+    }
+
+    std::uint64_t modulus() const { return m_; }
+
+    std::uint64_t reduce(u128 x) const
+    {
+        u128 r = x - mulhi(x, mu_) * m_;
+        while (r >= m_) {
+            r -= m_;
+        }
+        return static_cast<std::uint64_t>(r);
+    }
+
+    std::uint64_t mul(std::uint64_t a, std::uint64_t b) const { return reduce(static_cast<u128>(a) * b); }
+
+    // x^e for x < m.
+    std::uint64_t pow(std::uint64_t x, std::uint64_t e) const;
+
+private:
+    // High 128 bits of the 256-bit product x y.
+    static u128 mulhi(u128 x, u128 y)
+    {
+        const auto x0 = static_cast<std::uint64_t>(x);
+        const auto x1 = static_cast<std::uint64_t>(x >> 64);
+        const auto y0 = static_cast<std::uint64_t>(y);
+        const auto y1 = static_cast<std::uint64_t>(y >> 64);
+        const u128 p00 = static_cast<u128>(x0) * y0;
+        const u128 p01 = static_cast<u128>(x0) * y1;
+        const u128 p10 = static_cast<u128>(x1) * y0;
+        const u128 mid = (p00 >> 64) + static_cast<std::uint64_t>(p01) + static_cast<std::uint64_t>(p10);
+        return static_cast<u128>(x1) * y1 + (p01 >> 64) + (p10 >> 64) + (mid >> 64);
+    }
+
+    std::uint64_t m_;
+    u128 mu_;
+};
+
+// a^e mod m for m >= 1: Montgomery for odd m, Barrett otherwise.
+std::uint64_t powmod_u64(std::uint64_t a, std::uint64_t e, std::uint64_t m);
+
+// Montgomery and Barrett constants by modulus, for workloads where a few
+// moduli recur: each is computed on first use and then looked up. When
+// kMaxModuli distinct moduli are held, the cache starts over.
+class modulus_cache {
+public:
+    static constexpr size_t kMaxModuli = 1024;
+
+    // m must be odd.
+    const montgomery64& montgomery(std::uint64_t m) { return get(montgomery_, m); }
+    // m must be at least 1.
+    const barrett64& barrett(std::uint64_t m) { return get(barrett_, m); }
+
+private:
+    template <typename T>
+    static const T& get(std::unordered_map<std::uint64_t, T>& map, std::uint64_t m)
+    {
+        auto it = map.find(m);
+        if (it == map.end()) {
+            if (map.size() == kMaxModuli) {
+                map.clear();
+            }
+            it = map.emplace(m, T(m)).first;
+        }
+        return it->second;
+    }
+
+    std::unordered_map<std::uint64_t, montgomery64> montgomery_;
+    std::unordered_map<std::uint64_t, barrett64> barrett_;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Longest decimal form of an int64/uint64, including the sign.
+constexpr size_t kMaxIntChars = 20;
+
+// Write the decimal form of v starting at out (which must have room for
+// kMaxIntChars bytes) and return the end of it. No terminator is written.
+char* format_u64(std::uint64_t v, char* out);
+char* format_i64(std::int64_t v, char* out);
+
+// Longest lowercase hexadecimal form of a uint64, without prefix.
+constexpr size_t kMaxHexChars = 16;
+
+// Same as format_u64() in base 16; out needs room for kMaxHexChars bytes.
+char* format_hex_u64(std::uint64_t v, char* out);
+
+// Output buffer over a file descriptor that bypasses stdio: data is collected
+// in one large block and handed to write() when the block fills up or on
+// flush(). Writes larger than the block go straight to the descriptor.
+class out_buffer {
+public:
+    explicit out_buffer(int fd, size_t capacity = size_t { 1 } << 20);
+    ~out_buffer();
+
+    out_buffer(const out_buffer&) = delete;
+    out_buffer& operator=(const out_buffer&) = delete;
+
+    void write(const void* data, size_t n);
+    void put(char ch);
+    void put_i64(std::int64_t v);
+    void put_u64(std::uint64_t v);
+    // v as 8 little-endian bytes.
+    void put_le64(std::uint64_t v);
+
+    // Returns false if any write() so far has failed.
+    bool flush();
+    bool good() const { return !failed_; }
+
+private:
+    void reserve(size_t n);
+    bool drain(const char* p, size_t n);
+
+    int fd_;
+    std::vector<char> buf_;
+    size_t used_ = 0;
+    bool failed_ = false;
+};
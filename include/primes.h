@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Deterministic primality for any 64-bit n: trial division by the primes
+// below 64, then strong-probable-prime tests in Montgomery form with a base
+// set known to have no 64-bit pseudoprimes.
+bool is_prime_u64(std::uint64_t n);
+
+// Prime factors of n >= 1 in ascending order, repeated by multiplicity
+// (empty for 1): trial division by the primes below 1024, then Pollard-Brent
+// rho on what is left, with is_prime_u64() telling when to stop.
+std::vector<std::uint64_t> factor_u64(std::uint64_t n);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <output.h>
+
+#include <cstdint>
+
+// Segmented sieve of Eratosthenes over [a, b]. Segments hold the numbers
+// coprime to 30, eight to a byte, and are sized to stay in cache; threads
+// take runs of consecutive segments.
+
+// Largest b accepted: the sieving primes up to sqrt(b) are kept in memory.
+constexpr std::uint64_t kSieveMax = 100000000000000ULL; // 10^14
+
+// Number of primes p with a <= p <= b, for a <= b <= kSieveMax.
+std::uint64_t count_primes(std::uint64_t a, std::uint64_t b, unsigned threads);
+
+// Writes the primes in [a, b] to out in ascending order, one per line. Only
+// a window of a few segments per thread is held in memory at a time.
+// Returns false if writing failed.
+bool write_primes(std::uint64_t a, std::uint64_t b, unsigned threads, out_buffer& out);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct worker_stats {
+    std::uint64_t executed = 0;
+    std::uint64_t stolen = 0;
+    std::uint64_t failed_steals = 0;
+    std::uint64_t busy_ns = 0;
+};
+
+// Fixed set of threads that repeatedly execute a batch of indexed jobs on a
+// work-stealing scheduler. Each worker owns a deque seeded with a contiguous
+// range of job indices and takes jobs from its head; an idle worker steals
+// from the tail of another worker's deque, so the jobs left for the owner stay
+// contiguous.
+class worker_pool {
+public:
+    explicit worker_pool(unsigned threads);
+    ~worker_pool();
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+
+    // Calls job(i) for every i in [0, jobs) and returns once all of them have
+    // finished. Jobs must be independent of each other; at most 2^32 - 1 jobs
+    // per call.
+    void run(size_t jobs, const std::function<void(size_t)>& job);
+
+    // Cumulative over all run() calls; only meaningful between them.
+    std::vector<worker_stats> stats() const;
+
+private:
+    // Job indices [head, tail) packed as head | tail << 32 so that the owner
+    // and thieves can both claim a job with one compare-and-swap.
+    struct alignas(64) worker {
+        std::atomic<std::uint64_t> range { 0 };
+        worker_stats stats;
+    };
+
+    void loop(unsigned id);
+    bool pop(worker& w, size_t* job);
+    bool steal(worker& w, size_t* job);
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<worker[]> workers_;
+    std::mutex m_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* job_ = nullptr;
+    std::uint64_t generation_ = 0;
+    unsigned busy_ = 0;
+    bool stop_ = false;
+};
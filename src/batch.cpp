@@ -0,0 +1,591 @@
+#include <batch.h>
+#include <worker_pool.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMaxTokens = 4;
+constexpr size_t kRecordsPerBlock = 4096;
+constexpr size_t kFlushBytes = size_t { 1 } << 16;
+// Input handed to the workers at once; bounds the output buffered per window.
+constexpr size_t kWindowBytes = size_t { 16 } << 20;
+// Windows are cut into tasks of about this size so that idle workers have
+// something to steal when some lines are much more expensive than others.
+constexpr size_t kTaskBytes = size_t { 64 } << 10;
+
+const char* check_err_str(check_error e)
+{
+    switch (e) {
+    case check_error::missing_operand:
+        return "missing operand";
+    case check_error::useless_b:
+        return "useless b for this op";
+    case check_error::missing_b:
+        return "missing b for this op";
+    case check_error::pow_domain:
+        return "pow: domain error (b must be >= 0)";
+    case check_error::fact_domain:
+        return "fact: domain error (a must be >= 0)";
+    case check_error::missing_m:
+        return "missing m for this op";
+    case check_error::useless_m:
+        return "useless m for this op";
+    case check_error::powmod_domain:
+        return "powmod: domain error (b must be >= 0, m > 0)";
+    case check_error::factor_domain:
+        return "factor: domain error (a must be >= 1)";
+    case check_error::sieve_domain:
+        return "sieve: domain error (0 <= a <= b <= 10^14)";
+    case check_error::binom_domain:
+        return "binom: domain error (n and k must be >= 0)";
+    case check_error::none:
+    default:
+        return "invalid input";
+    }
+}
+
+struct token {
+    const char* p;
+    size_t n;
+};
+
+bool is_blank(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+size_t split(const char* p, const char* end, token* tokens)
+{
+    size_t n = 0;
+    while (p != end) {
+        while (p != end && is_blank(*p)) {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+        if (n == kMaxTokens) {
+            return n + 1;
+        }
+        const char* start = p;
+        while (p != end && !is_blank(*p)) {
+            ++p;
+        }
+        tokens[n++] = { start, static_cast<size_t>(p - start) };
+    }
+    return n;
+}
+
+void append_error(std::string& out, const char* what)
+{
+    out += "error: ";
+    out += what;
+    out += '\n';
+}
+
+void append_error(std::string& out, const char* what, const token& t)
+{
+    out += "error: ";
+    out += what;
+    out += " '";
+    out.append(t.p, t.n);
+    out += "'\n";
+}
+
+void append_value(std::string& out, const mathlib::ml_result& r)
+{
+    char buf[kMaxIntChars];
+    char* end = r.kind == mathlib::ml_kind::i64 ? format_i64(r.value.i64, buf) : format_u64(r.value.u64, buf);
+    out.append(buf, static_cast<size_t>(end - buf));
+}
+
+// Space-separated, so an empty line stands for 1.
+void append_factors(std::string& out, const std::vector<std::uint64_t>& factors)
+{
+    char buf[kMaxIntChars];
+    for (size_t i = 0; i < factors.size(); ++i) {
+        if (i != 0) {
+            out += ' ';
+        }
+        out.append(buf, static_cast<size_t>(format_u64(factors[i], buf) - buf));
+    }
+}
+
+void eval_line(context& c, const char* line, const char* end, bool big, std::string& out)
+{
+    c = context {};
+
+    token tokens[kMaxTokens] = {};
+    const size_t n = split(line, end, tokens);
+    if (n == 0) {
+        append_error(out, "empty line");
+        return;
+    }
+    if (n > kMaxTokens) {
+        append_error(out, "too many operands");
+        return;
+    }
+
+    c.have_op = parse_op(tokens[0].p, tokens[0].n, &c.op);
+    if (!c.have_op) {
+        append_error(out, "unknown operation", tokens[0]);
+        return;
+    }
+    c.big = big || is_big_op(c.op);
+    if (n > 1) {
+        c.have_a = c.big ? bigint::parse(tokens[1].p, tokens[1].n, &c.big_a) : parse_i64(tokens[1].p, tokens[1].n, &c.a);
+        if (!c.have_a) {
+            append_error(out, "invalid integer for a:", tokens[1]);
+            return;
+        }
+    }
+    if (n > 2) {
+        c.have_b = c.big ? bigint::parse(tokens[2].p, tokens[2].n, &c.big_b) : parse_i64(tokens[2].p, tokens[2].n, &c.b);
+        if (!c.have_b) {
+            append_error(out, "invalid integer for b:", tokens[2]);
+            return;
+        }
+    }
+    if (n > 3) {
+        c.have_m = c.big ? bigint::parse(tokens[3].p, tokens[3].n, &c.big_m) : parse_i64(tokens[3].p, tokens[3].n, &c.m);
+        if (!c.have_m) {
+            append_error(out, "invalid integer for m:", tokens[3]);
+            return;
+        }
+    }
+
+    const check_error ce = validate(c);
+    if (ce != check_error::none) {
+        append_error(out, check_err_str(ce));
+        return;
+    }
+    if (c.op == operation::primes) {
+        append_error(out, "primes is a single operation only");
+        return;
+    }
+
+    if (calc(c) != exit_code::ok) {
+        append_error(out, "unknown operation");
+        return;
+    }
+    if (c.r.error != mathlib::ml_error::ok) {
+        append_error(out, math_err_str(c.r.error));
+        return;
+    }
+    if (c.op == operation::factor) {
+        append_factors(out, c.factors);
+    } else if (c.big) {
+        out += c.big_r.to_string();
+    } else {
+        append_value(out, c.r);
+    }
+    if (c.op == operation::divmod) {
+        out += ' ';
+        if (c.big) {
+            out += c.big_r2.to_string();
+        } else {
+            append_value(out, c.r2);
+        }
+    }
+    out += '\n';
+}
+
+void eval_lines(const char* p, const char* end, bool big, std::string& out)
+{
+    context c {};
+    while (p != end) {
+        const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+        const char* eol = nl != nullptr ? static_cast<const char*>(nl) : end;
+        eval_line(c, p, eol, big, out);
+        p = eol == end ? end : eol + 1;
+    }
+}
+
+bool write_all(out_buffer& out, const void* data, size_t size)
+{
+    out.write(data, size);
+    return out.good();
+}
+
+exit_code io_error()
+{
+    std::fprintf(stderr, "Error: batch: I/O error\n");
+    return exit_code::usage;
+}
+
+exit_code finish(out_buffer& out)
+{
+    if (!out.flush()) {
+        return io_error();
+    }
+    return exit_code::ok;
+}
+
+std::unique_ptr<worker_pool> make_pool(const batch_options& o)
+{
+    if (o.threads <= 1) {
+        return nullptr;
+    }
+    return std::make_unique<worker_pool>(o.threads);
+}
+
+// Cuts [p, end) into `parts` consecutive pieces, each starting at a line start.
+std::vector<const char*> split_lines(const char* p, const char* end, size_t parts)
+{
+    std::vector<const char*> cuts { p };
+    const auto size = static_cast<size_t>(end - p);
+    for (size_t i = 1; i < parts; ++i) {
+        const char* target = std::max(p + size * i / parts, cuts.back());
+        const void* nl = std::memchr(target, '\n', static_cast<size_t>(end - target));
+        cuts.push_back(nl != nullptr ? static_cast<const char*>(nl) + 1 : end);
+    }
+    cuts.push_back(end);
+    return cuts;
+}
+
+// Evaluates whole lines in [p, end) as a set of tasks and writes the task
+// outputs in input order.
+bool eval_text_window(worker_pool* pool, const char* p, const char* end, bool big, std::vector<std::string>& outs,
+    out_buffer& out)
+{
+    if (pool == nullptr) {
+        outs.resize(1);
+        outs[0].clear();
+        eval_lines(p, end, big, outs[0]);
+        return write_all(out, outs[0].data(), outs[0].size());
+    }
+
+    const auto size = static_cast<size_t>(end - p);
+    outs.resize(std::max<size_t>(pool->size(), size / kTaskBytes));
+    const std::vector<const char*> cuts = split_lines(p, end, outs.size());
+    pool->run(outs.size(), [&](size_t i) {
+        outs[i].clear();
+        eval_lines(cuts[i], cuts[i + 1], big, outs[i]);
+    });
+    for (const std::string& s : outs) {
+        if (!write_all(out, s.data(), s.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::uint64_t load_le64(const unsigned char* p)
+{
+    std::uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        v |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+void store_le64(unsigned char* p, std::uint64_t v)
+{
+    for (size_t i = 0; i < 8; ++i) {
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+    }
+}
+
+// Operations with at most two i64 operands and one scalar result, the only
+// ones a 17-byte request and a 10-byte response can carry.
+bool fits_record(std::uint8_t op)
+{
+    if (op > static_cast<std::uint8_t>(operation::none) && op <= static_cast<std::uint8_t>(operation::fact)) {
+        return true;
+    }
+    const auto o = static_cast<operation>(op);
+    return o == operation::mod || o == operation::isprime || o == operation::primecount || o == operation::binom;
+}
+
+void eval_record(context& c, const unsigned char* in, unsigned char* out)
+{
+    c = context {};
+
+    wire_error err = wire_error::ok;
+    const std::uint8_t op = in[0];
+    if (fits_record(op)) {
+        c.op = static_cast<operation>(op);
+        c.have_op = true;
+        c.a = static_cast<std::int64_t>(load_le64(in + 1));
+        c.have_a = true;
+        c.have_b = needs_b(c.op);
+        c.b = c.have_b ? static_cast<std::int64_t>(load_le64(in + 9)) : 0;
+
+        if (validate(c) != check_error::none) {
+            err = wire_error::domain;
+        } else if (calc(c) != exit_code::ok) {
+            err = wire_error::bad_op;
+        } else {
+            err = to_wire(c.r.error);
+        }
+    } else {
+        err = wire_error::bad_op;
+    }
+
+    const bool ok = err == wire_error::ok;
+    const bool is_u64 = ok && c.r.kind != mathlib::ml_kind::i64;
+    out[0] = static_cast<unsigned char>(is_u64 ? wire_kind::u64 : wire_kind::i64);
+    out[1] = static_cast<unsigned char>(err);
+    std::uint64_t v = 0;
+    if (ok) {
+        v = is_u64 ? c.r.value.u64 : static_cast<std::uint64_t>(c.r.value.i64);
+    }
+    store_le64(out + 2, v);
+}
+
+void eval_records(const unsigned char* in, size_t records, unsigned char* out)
+{
+    context c {};
+    for (size_t i = 0; i < records; ++i) {
+        eval_record(c, in + i * kRecordInSize, out + i * kRecordOutSize);
+    }
+}
+
+bool eval_binary_window(worker_pool* pool, const unsigned char* in, size_t records, std::vector<unsigned char>& obuf, out_buffer& out)
+{
+    obuf.resize(records * kRecordOutSize);
+    if (pool == nullptr) {
+        eval_records(in, records, obuf.data());
+    } else {
+        const size_t tasks = (records + kRecordsPerBlock - 1) / kRecordsPerBlock;
+        pool->run(tasks, [&](size_t i) {
+            const size_t first = i * kRecordsPerBlock;
+            const size_t count = std::min(kRecordsPerBlock, records - first);
+            eval_records(in + first * kRecordInSize, count, obuf.data() + first * kRecordOutSize);
+        });
+    }
+    return write_all(out, obuf.data(), obuf.size());
+}
+
+size_t window_records(const worker_pool* pool)
+{
+    return pool != nullptr ? kWindowBytes / kRecordInSize : kRecordsPerBlock;
+}
+
+exit_code truncated(size_t trailing)
+{
+    std::fprintf(stderr, "Error: batch: truncated record (%zu trailing bytes)\n", trailing);
+    return exit_code::usage;
+}
+
+// Reads from `in` until the buffer holds `want` bytes or the stream ends.
+size_t fill(std::FILE* in, std::vector<char>& buf, size_t used, size_t want)
+{
+    if (buf.size() < want) {
+        buf.resize(want);
+    }
+    return used + std::fread(buf.data() + used, 1, want - used, in);
+}
+
+exit_code run_batch_lines(std::FILE* in, out_buffer& out, bool big)
+{
+    context c {};
+    std::string obuf;
+    char* line = nullptr;
+    size_t cap = 0;
+    ssize_t len = 0;
+    bool write_failed = false;
+
+    while (!write_failed && (len = ::getline(&line, &cap, in)) != -1) {
+        eval_line(c, line, line + len, big, obuf);
+        if (obuf.size() >= kFlushBytes) {
+            write_failed = !write_all(out, obuf.data(), obuf.size());
+            obuf.clear();
+        }
+    }
+    std::free(line);
+
+    if (write_failed || std::ferror(in) != 0 || !write_all(out, obuf.data(), obuf.size())) {
+        return io_error();
+    }
+    return finish(out);
+}
+
+exit_code run_text_stream(worker_pool& pool, std::FILE* in, out_buffer& out, bool big)
+{
+    std::vector<std::string> outs;
+    std::vector<char> buf;
+    size_t used = 0;
+    bool eof = false;
+    while (!eof) {
+        used = fill(in, buf, used, std::max(buf.size(), used + kWindowBytes / 2));
+        eof = std::feof(in) != 0 || std::ferror(in) != 0;
+
+        size_t take = used;
+        if (!eof) {
+            const char* last = nullptr;
+            for (size_t i = used; i > 0; --i) {
+                if (buf[i - 1] == '\n') {
+                    last = buf.data() + i;
+                    break;
+                }
+            }
+            if (last == nullptr) {
+                continue;
+            }
+            take = static_cast<size_t>(last - buf.data());
+        }
+
+        if (!eval_text_window(&pool, buf.data(), buf.data() + take, big, outs, out)) {
+            return io_error();
+        }
+        std::memmove(buf.data(), buf.data() + take, used - take);
+        used -= take;
+    }
+
+    if (std::ferror(in) != 0) {
+        return io_error();
+    }
+    return finish(out);
+}
+
+exit_code run_binary_stream(worker_pool* pool, std::FILE* in, out_buffer& out)
+{
+    const size_t window = window_records(pool) * kRecordInSize;
+
+    std::vector<char> ibuf;
+    std::vector<unsigned char> obuf;
+    size_t used = 0;
+    bool eof = false;
+    while (!eof) {
+        used = fill(in, ibuf, used, window);
+        eof = used < window;
+
+        const size_t records = used / kRecordInSize;
+        if (!eval_binary_window(pool, reinterpret_cast<const unsigned char*>(ibuf.data()), records, obuf, out)) {
+            return io_error();
+        }
+        const size_t take = records * kRecordInSize;
+        std::memmove(ibuf.data(), ibuf.data() + take, used - take);
+        used -= take;
+    }
+
+    if (std::ferror(in) != 0) {
+        return io_error();
+    }
+    const exit_code rc = finish(out);
+    if (rc != exit_code::ok) {
+        return rc;
+    }
+    if (used != 0) {
+        return truncated(used);
+    }
+    return exit_code::ok;
+}
+
+exit_code run_text_buffer(worker_pool* pool, const char* data, size_t size, out_buffer& out, bool big)
+{
+    std::vector<std::string> outs;
+
+    const char* p = data;
+    const char* end = data + size;
+    while (p != end) {
+        const char* wend = end;
+        if (static_cast<size_t>(end - p) > kWindowBytes) {
+            const char* target = p + kWindowBytes;
+            const void* nl = std::memchr(target, '\n', static_cast<size_t>(end - target));
+            wend = nl != nullptr ? static_cast<const char*>(nl) + 1 : end;
+        }
+        if (!eval_text_window(pool, p, wend, big, outs, out)) {
+            return io_error();
+        }
+        p = wend;
+    }
+    return finish(out);
+}
+
+exit_code run_binary_buffer(worker_pool* pool, const char* data, size_t size, out_buffer& out)
+{
+    const size_t window = window_records(pool);
+    const auto* in = reinterpret_cast<const unsigned char*>(data);
+    const size_t total = size / kRecordInSize;
+
+    std::vector<unsigned char> obuf;
+    for (size_t done = 0; done < total;) {
+        const size_t records = std::min(window, total - done);
+        if (!eval_binary_window(pool, in + done * kRecordInSize, records, obuf, out)) {
+            return io_error();
+        }
+        done += records;
+    }
+
+    const exit_code rc = finish(out);
+    if (rc != exit_code::ok) {
+        return rc;
+    }
+    if (size % kRecordInSize != 0) {
+        return truncated(size % kRecordInSize);
+    }
+    return exit_code::ok;
+}
+
+void report(const worker_pool* pool, const batch_options& o)
+{
+    if (pool == nullptr || !o.stats) {
+        return;
+    }
+    const std::vector<worker_stats> stats = pool->stats();
+    for (size_t i = 0; i < stats.size(); ++i) {
+        std::fprintf(stderr, "worker %zu: tasks=%llu stolen=%llu failed_steals=%llu busy=%.3fms\n", i,
+            static_cast<unsigned long long>(stats[i].executed),
+            static_cast<unsigned long long>(stats[i].stolen),
+            static_cast<unsigned long long>(stats[i].failed_steals),
+            static_cast<double>(stats[i].busy_ns) / 1e6);
+    }
+}
+
+} // namespace
+
+wire_error to_wire(mathlib::ml_error e)
+{
+    switch (e) {
+    case mathlib::ml_error::ok:
+        return wire_error::ok;
+    case mathlib::ml_error::div0:
+        return wire_error::div0;
+    case mathlib::ml_error::overflow:
+        return wire_error::overflow;
+    default:
+        return wire_error::math;
+    }
+}
+
+exit_code run_batch(std::FILE* in, out_buffer& out, const batch_options& o)
+{
+    std::unique_ptr<worker_pool> pool = make_pool(o);
+    const exit_code rc = pool ? run_text_stream(*pool, in, out, o.bigint) : run_batch_lines(in, out, o.bigint);
+    report(pool.get(), o);
+    return rc;
+}
+
+exit_code run_batch_binary(std::FILE* in, out_buffer& out, const batch_options& o)
+{
+    std::unique_ptr<worker_pool> pool = make_pool(o);
+    const exit_code rc = run_binary_stream(pool.get(), in, out);
+    report(pool.get(), o);
+    return rc;
+}
+
+exit_code run_batch_buffer(const char* data, size_t size, out_buffer& out, const batch_options& o)
+{
+    std::unique_ptr<worker_pool> pool = make_pool(o);
+    const exit_code rc = run_text_buffer(pool.get(), data, size, out, o.bigint);
+    report(pool.get(), o);
+    return rc;
+}
+
+exit_code run_batch_binary_buffer(const char* data, size_t size, out_buffer& out, const batch_options& o)
+{
+    std::unique_ptr<worker_pool> pool = make_pool(o);
+    const exit_code rc = run_binary_buffer(pool.get(), data, size, out);
+    report(pool.get(), o);
+    return rc;
+}
@@ -0,0 +1,1636 @@
+#include <bigint.h>
+#include <output.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+__extension__ using u128 = unsigned __int128;
+using limb = bigint::limb;
+
+// Largest power of ten that fits in a limb, used for decimal conversion.
+constexpr limb kDecimalBase = 10000000000000000000ULL;
+constexpr size_t kDecimalBaseDigits = 19;
+
+// Operand sizes in limbs from which multiplication switches from schoolbook
+// to Karatsuba, from Karatsuba to Toom-3 and from Toom-3 to the NTT. Measure
+// with mul_bench and set through the CALC_*_THRESHOLD CMake cache variables.
+#ifndef CALC_KARATSUBA_THRESHOLD
+#define CALC_KARATSUBA_THRESHOLD 32
+#endif
+#ifndef CALC_TOOM3_THRESHOLD
+#define CALC_TOOM3_THRESHOLD 320
+#endif
+#ifndef CALC_NTT_THRESHOLD
+#define CALC_NTT_THRESHOLD 6144
+#endif
+
+constexpr size_t kKaratsubaThreshold = CALC_KARATSUBA_THRESHOLD;
+constexpr size_t kToom3Threshold = CALC_TOOM3_THRESHOLD;
+constexpr size_t kNttThreshold = CALC_NTT_THRESHOLD;
+
+// Numbers from this many limbs up are converted to and from decimal by
+// divide and conquer; below it by repeated division or multiplication by
+// 10^19.
+constexpr size_t kDecimalDcThreshold = 32;
+
+// Printing by divide and conquer first pays for reciprocals of the powers
+// of ten, so it only wins from this many limbs up.
+constexpr size_t kToStringDcThreshold = 640;
+
+// Reciprocals of divisors up to this many limbs come from plain division.
+constexpr size_t kNewtonThreshold = 32;
+
+// Division switches from schoolbook to Newton's reciprocal when both the
+// divisor and the quotient have at least this many limbs. It must stay above
+// kNewtonThreshold, whose reciprocals use schoolbook division.
+constexpr size_t kDivNewtonThreshold = 384;
+static_assert(kDivNewtonThreshold > kNewtonThreshold, "reciprocal() would recurse");
+
+// Factor lists shorter than this are multiplied one by one.
+constexpr size_t kProductLeaf = 16;
+
+// C(n, k) with k = min(k, n - k) comes from its prime factorization, which
+// sieves up to n, while n / k is at most kBinomialLegendreRatio; beyond
+// that, or above kBinomialSieveMax, n (n - 1) ... (n - k + 1) / k! is
+// cheaper.
+constexpr std::uint64_t kBinomialLegendreRatio = 256;
+constexpr std::uint64_t kBinomialSieveMax = std::uint64_t { 1 } << 32;
+
+int cmp_n(const limb* a, const limb* b, size_t n)
+{
+    for (size_t i = n; i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Compares magnitudes without leading zero limbs.
+int cmp(const limb* a, size_t an, const limb* b, size_t bn)
+{
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    return cmp_n(a, b, an);
+}
+
+// r[0..an) = a[0..an) + b[0..bn) with an >= bn, returns the carry.
+limb add(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    limb carry = 0;
+    for (size_t i = 0; i < bn; ++i) {
+        const limb t = a[i] + carry;
+        carry = static_cast<limb>(t < carry);
+        r[i] = t + b[i];
+        carry += static_cast<limb>(r[i] < t);
+    }
+    for (size_t i = bn; i < an; ++i) {
+        r[i] = a[i] + carry;
+        carry = static_cast<limb>(r[i] < carry);
+    }
+    return carry;
+}
+
+// r[0..an) = a[0..an) - b[0..bn) with a >= b, returns the borrow.
+limb sub(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    limb borrow = 0;
+    for (size_t i = 0; i < bn; ++i) {
+        const limb t = a[i] - b[i];
+        const limb b1 = static_cast<limb>(a[i] < b[i]);
+        r[i] = t - borrow;
+        borrow = b1 | static_cast<limb>(t < borrow);
+    }
+    for (size_t i = bn; i < an; ++i) {
+        r[i] = a[i] - borrow;
+        borrow = static_cast<limb>(a[i] < borrow);
+    }
+    return borrow;
+}
+
+// r[0..n) = a[0..n) * m, returns the carry limb.
+limb mul_1(limb* r, const limb* a, size_t n, limb m)
+{
+    limb carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const u128 t = static_cast<u128>(a[i]) * m + carry;
+        r[i] = static_cast<limb>(t);
+        carry = static_cast<limb>(t >> 64);
+    }
+    return carry;
+}
+
+// r[0..n) += a[0..n) * m, returns the carry limb.
+limb addmul_1(limb* r, const limb* a, size_t n, limb m)
+{
+    limb carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const u128 t = static_cast<u128>(a[i]) * m + r[i] + carry;
+        r[i] = static_cast<limb>(t);
+        carry = static_cast<limb>(t >> 64);
+    }
+    return carry;
+}
+
+// r[0..an+bn) = a * b; r must not overlap the inputs.
+void mul_basecase(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    r[an] = mul_1(r, a, an, b[0]);
+    for (size_t j = 1; j < bn; ++j) {
+        r[an + j] = addmul_1(r + j, a, an, b[j]);
+    }
+}
+
+// r[0..2n) = a^2 with about half the limb products of mul_basecase(): each
+// cross product a[i] a[j], i < j, is summed once and the total doubled, then
+// the squares a[i]^2 are added on the diagonal.
+void sqr_basecase(limb* r, const limb* a, size_t n)
+{
+    std::fill(r, r + 2 * n, 0);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        r[n + i] = addmul_1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+
+    limb carry = 0;
+    for (size_t i = 0; i < 2 * n; ++i) {
+        const limb v = r[i];
+        r[i] = (v << 1) | carry;
+        carry = v >> 63;
+    }
+
+    carry = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const u128 sq = static_cast<u128>(a[i]) * a[i];
+        const u128 lo = static_cast<u128>(r[2 * i]) + static_cast<limb>(sq) + carry;
+        r[2 * i] = static_cast<limb>(lo);
+        const u128 hi = static_cast<u128>(r[2 * i + 1]) + static_cast<limb>(sq >> 64) + static_cast<limb>(lo >> 64);
+        r[2 * i + 1] = static_cast<limb>(hi);
+        carry = static_cast<limb>(hi >> 64);
+    }
+}
+
+size_t trimmed(const limb* p, size_t n)
+{
+    while (n > 0 && p[n - 1] == 0) {
+        --n;
+    }
+    return n;
+}
+
+// r[0..rn) += a[0..an) with an <= rn; the sum must fit in rn limbs.
+void add_into(limb* r, size_t rn, const limb* a, size_t an)
+{
+    limb carry = add(r, r, an, a, an);
+    for (size_t i = an; carry != 0 && i < rn; ++i) {
+        r[i] += carry;
+        carry = static_cast<limb>(r[i] == 0);
+    }
+}
+
+// r[0..rn) -= a[0..an) with an <= rn; the difference must not be negative.
+void sub_into(limb* r, size_t rn, const limb* a, size_t an)
+{
+    limb borrow = sub(r, r, an, a, an);
+    for (size_t i = an; borrow != 0 && i < rn; ++i) {
+        borrow = static_cast<limb>(r[i] == 0);
+        r[i] -= 1;
+    }
+}
+
+// a[0..n) /= d in place, returns the remainder.
+limb divrem_1(limb* a, size_t n, limb d)
+{
+    limb rem = 0;
+    for (size_t i = n; i-- > 0;) {
+        const u128 t = (static_cast<u128>(rem) << 64) | a[i];
+        a[i] = static_cast<limb>(t / d);
+        rem = static_cast<limb>(t % d);
+    }
+    return rem;
+}
+
+// Knuth's algorithm D. On entry u holds the dividend with one extra zero
+// limb on top (un + 1 limbs) and v the divisor (vn >= 2 limbs), both already
+// shifted left so that the top bit of v is set. On exit q[0..un-vn] holds the
+// quotient and u[0..vn) the (shifted) remainder.
+void divrem_knuth(limb* q, limb* u, size_t un, const limb* v, size_t vn)
+{
+    const limb vtop = v[vn - 1];
+    const limb vnext = v[vn - 2];
+    for (size_t j = un - vn + 1; j-- > 0;) {
+        const u128 num = (static_cast<u128>(u[j + vn]) << 64) | u[j + vn - 1];
+        u128 qhat = num / vtop;
+        u128 rhat = num % vtop;
+        while ((qhat >> 64) != 0 || qhat * vnext > ((rhat << 64) | u[j + vn - 2])) {
+            --qhat;
+            rhat += vtop;
+            if ((rhat >> 64) != 0) {
+                break;
+            }
+        }
+
+        // u[j..j+vn] -= qhat * v
+        const auto qd = static_cast<limb>(qhat);
+        limb carry = 0;
+        limb borrow = 0;
+        for (size_t i = 0; i < vn; ++i) {
+            const u128 p = static_cast<u128>(qd) * v[i] + carry;
+            carry = static_cast<limb>(p >> 64);
+            const auto plo = static_cast<limb>(p);
+            const limb t = u[i + j] - plo;
+            const limb b1 = static_cast<limb>(u[i + j] < plo);
+            u[i + j] = t - borrow;
+            borrow = b1 | static_cast<limb>(t < borrow);
+        }
+        const u128 sub_top = static_cast<u128>(carry) + borrow;
+        const bool negative = static_cast<u128>(u[j + vn]) < sub_top;
+        u[j + vn] = static_cast<limb>(u[j + vn] - sub_top);
+
+        q[j] = qd;
+        if (negative) {
+            // qhat was one too large: add v back.
+            --q[j];
+            u[j + vn] += add(u + j, u + j, vn, v, vn);
+        }
+    }
+}
+
+void mul_limbs(limb* r, const limb* a, size_t an, const limb* b, size_t bn);
+
+// a = a1 B^h + a0, b = b1 B^h + b0 with h = ceil(an / 2):
+// a*b = z2 B^2h + ((a0 + a1)(b0 + b1) - z0 - z2) B^h + z0. Squares stay
+// squares all the way down.
+void mul_karatsuba(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    const size_t h = (an + 1) / 2;
+    const size_t a1n = an - h;
+    const size_t b0n = std::min(h, bn);
+    const size_t b1n = bn - b0n;
+
+    std::fill(r, r + an + bn, 0);
+    mul_limbs(r, a, h, b, b0n);
+    if (b1n > 0) {
+        mul_limbs(r + 2 * h, a + h, a1n, b + h, b1n);
+    }
+
+    std::vector<limb> sa(h + 1);
+    sa[h] = add(sa.data(), a, h, a + h, a1n);
+    std::vector<limb> sb;
+    const limb* sbp = sa.data();
+    if (a != b || an != bn) {
+        sb.resize(b0n + 1);
+        sb[b0n] = add(sb.data(), b, b0n, b + h, b1n);
+        sbp = sb.data();
+    }
+
+    const size_t san = trimmed(sa.data(), sa.size());
+    const size_t sbn = sbp == sa.data() ? san : trimmed(sb.data(), sb.size());
+    std::vector<limb> z1(san + sbn);
+    mul_limbs(z1.data(), sa.data(), san, sbp, sbn);
+    sub_into(z1.data(), z1.size(), r, trimmed(r, h + b0n));
+    if (b1n > 0) {
+        sub_into(z1.data(), z1.size(), r + 2 * h, trimmed(r + 2 * h, a1n + b1n));
+    }
+    add_into(r + h, an + bn - h, z1.data(), trimmed(z1.data(), z1.size()));
+}
+
+bigint divexact(const bigint& x, limb d)
+{
+    bigint q;
+    divmod(x, bigint::from_u64(d), &q, nullptr);
+    return q;
+}
+
+// Splits both operands in three k-limb parts, evaluates at 0, 1, -1, -2 and
+// infinity and interpolates with Bodrato's sequence.
+void mul_toom3(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    const size_t k = (an + 2) / 3;
+    const auto part = [k](const limb* p, size_t n, size_t i) {
+        const size_t lo = std::min(n, i * k);
+        const size_t hi = std::min(n, lo + k);
+        return bigint::from_limbs(p + lo, hi - lo);
+    };
+    const bigint a0 = part(a, an, 0);
+    const bigint a1 = part(a, an, 1);
+    const bigint a2 = part(a, an, 2);
+    const bigint b0 = part(b, bn, 0);
+    const bigint b1 = part(b, bn, 1);
+    const bigint b2 = part(b, bn, 2);
+
+    const bigint pa = a0 + a2;
+    const bigint pa_1 = pa + a1;
+    const bigint pa_m1 = pa - a1;
+    bigint pa_m2 = pa_m1 + a2;
+    pa_m2 <<= 1;
+    pa_m2 = pa_m2 - a0;
+
+    const bigint pb = b0 + b2;
+    const bigint pb_1 = pb + b1;
+    const bigint pb_m1 = pb - b1;
+    bigint pb_m2 = pb_m1 + b2;
+    pb_m2 <<= 1;
+    pb_m2 = pb_m2 - b0;
+
+    // Squaring multiplies each point value by itself, which the callee
+    // recognizes as a square.
+    const bool square = a == b && an == bn;
+    const bigint r0 = square ? a0 * a0 : a0 * b0;
+    const bigint r_1 = square ? pa_1 * pa_1 : pa_1 * pb_1;
+    const bigint r_m1 = square ? pa_m1 * pa_m1 : pa_m1 * pb_m1;
+    const bigint r_m2 = square ? pa_m2 * pa_m2 : pa_m2 * pb_m2;
+    const bigint r_inf = square ? a2 * a2 : a2 * b2;
+
+    bigint c3 = divexact(r_m2 - r_1, 3);
+    bigint c1 = divexact(r_1 - r_m1, 2);
+    bigint c2 = r_m1 - r0;
+    c3 = divexact(c2 - c3, 2) + r_inf + r_inf;
+    c2 = c2 + c1 - r_inf;
+    c1 = c1 - c3;
+
+    const size_t rn = an + bn;
+    std::fill(r, r + rn, 0);
+    const bigint* coeffs[] = { &r0, &c1, &c2, &c3, &r_inf };
+    for (size_t i = 0; i < 5; ++i) {
+        const bigint& c = *coeffs[i];
+        if (!c.is_zero()) {
+            add_into(r + i * k, rn - i * k, c.data(), c.size());
+        }
+    }
+}
+
+// Number-theoretic transform modulo a prime P = c * 2^k + 1 with primitive
+// root 3. Residues are kept below P < 2^30, so sums never wrap.
+template <std::uint32_t P>
+struct ntt_prime {
+    static std::uint32_t add(std::uint32_t a, std::uint32_t b)
+    {
+        const std::uint32_t s = a + b;
+        return s >= P ? s - P : s;
+    }
+
+    static std::uint32_t sub(std::uint32_t a, std::uint32_t b)
+    {
+        return a >= b ? a - b : a + P - b;
+    }
+
+    static std::uint32_t mul(std::uint32_t a, std::uint32_t b)
+    {
+        return static_cast<std::uint32_t>(std::uint64_t { a } * b % P);
+    }
+
+    static std::uint32_t pow(std::uint32_t a, std::uint64_t e)
+    {
+        std::uint32_t r = 1;
+        for (; e != 0; e >>= 1) {
+            if (e & 1) {
+                r = mul(r, a);
+            }
+            a = mul(a, a);
+        }
+        return r;
+    }
+
+    // roots[len + j] = w^j for the primitive (2 * len)-th root of unity w,
+    // or its inverse.
+    static void twiddles(std::vector<std::uint32_t>& roots, size_t n, bool inverse)
+    {
+        roots.resize(n);
+        for (size_t len = 1; len < n; len *= 2) {
+            std::uint32_t w = pow(3, (P - 1) / (2 * len));
+            if (inverse) {
+                w = pow(w, P - 2);
+            }
+            std::uint32_t x = 1;
+            for (size_t j = 0; j < len; ++j) {
+                roots[len + j] = x;
+                x = mul(x, w);
+            }
+        }
+    }
+
+    // Decimation in frequency: natural order in, bit-reversed order out.
+    static void forward(std::uint32_t* a, size_t n, const std::uint32_t* roots)
+    {
+        for (size_t len = n / 2; len > 0; len /= 2) {
+            for (size_t i = 0; i < n; i += 2 * len) {
+                for (size_t j = 0; j < len; ++j) {
+                    const std::uint32_t u = a[i + j];
+                    const std::uint32_t v = a[i + j + len];
+                    a[i + j] = add(u, v);
+                    a[i + j + len] = mul(sub(u, v), roots[len + j]);
+                }
+            }
+        }
+    }
+
+    // Decimation in time: bit-reversed order in, natural order out, scaled
+    // by 1/n so that it undoes forward().
+    static void inverse(std::uint32_t* a, size_t n, const std::uint32_t* roots)
+    {
+        for (size_t len = 1; len < n; len *= 2) {
+            for (size_t i = 0; i < n; i += 2 * len) {
+                for (size_t j = 0; j < len; ++j) {
+                    const std::uint32_t u = a[i + j];
+                    const std::uint32_t v = mul(a[i + j + len], roots[len + j]);
+                    a[i + j] = add(u, v);
+                    a[i + j + len] = sub(u, v);
+                }
+            }
+        }
+        const std::uint32_t inv_n = pow(static_cast<std::uint32_t>(n % P), P - 2);
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = mul(a[i], inv_n);
+        }
+    }
+
+    // The 32-bit halves of a[0..an), reduced mod P and zero-padded to n.
+    static void load(std::vector<std::uint32_t>& c, const limb* a, size_t an, size_t n)
+    {
+        c.assign(n, 0);
+        for (size_t i = 0; i < an; ++i) {
+            c[2 * i] = static_cast<std::uint32_t>(a[i]) % P;
+            c[2 * i + 1] = static_cast<std::uint32_t>(a[i] >> 32) % P;
+        }
+    }
+
+    // out = the product's 32-bit coefficients mod P, as a cyclic
+    // convolution of length n. Squares need one forward transform only.
+    static void convolve(std::vector<std::uint32_t>& out, const limb* a, size_t an, const limb* b, size_t bn, size_t n)
+    {
+        std::vector<std::uint32_t> roots;
+        twiddles(roots, n, false);
+        load(out, a, an, n);
+        forward(out.data(), n, roots.data());
+        if (a == b && an == bn) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = mul(out[i], out[i]);
+            }
+        } else {
+            std::vector<std::uint32_t> tb;
+            load(tb, b, bn, n);
+            forward(tb.data(), n, roots.data());
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = mul(out[i], tb[i]);
+            }
+        }
+        twiddles(roots, n, true);
+        inverse(out.data(), n, roots.data());
+    }
+};
+
+constexpr std::uint32_t kNttP0 = 998244353; // 119 * 2^23 + 1
+constexpr std::uint32_t kNttP1 = 167772161; // 5 * 2^25 + 1
+constexpr std::uint32_t kNttP2 = 469762049; // 7 * 2^26 + 1
+
+// A product coefficient sums at most 2^20 products of two 32-bit halves, so
+// it stays below 2^84 and the three primes (together above 2^86) pin it
+// down exactly.
+constexpr size_t kNttMaxLength = size_t { 1 } << 21;
+
+constexpr std::uint32_t inverse_mod(std::uint64_t a, std::uint32_t p)
+{
+    std::uint64_t r = 1;
+    a %= p;
+    for (std::uint32_t e = p - 2; e != 0; e >>= 1) {
+        if (e & 1) {
+            r = r * a % p;
+        }
+        a = a * a % p;
+    }
+    return static_cast<std::uint32_t>(r);
+}
+
+constexpr std::uint64_t kNttP01 = std::uint64_t { kNttP0 } * kNttP1;
+constexpr std::uint32_t kNttInvP0 = inverse_mod(kNttP0, kNttP1);
+constexpr std::uint32_t kNttInvP01 = inverse_mod(kNttP01, kNttP2);
+
+// Garner's reconstruction of x < P0 P1 P2 from its three residues.
+u128 crt(std::uint32_t x0, std::uint32_t x1, std::uint32_t x2)
+{
+    const std::uint64_t v1 = std::uint64_t { ntt_prime<kNttP1>::sub(x1, x0 % kNttP1) } * kNttInvP0 % kNttP1;
+    const std::uint64_t low = x0 + v1 * kNttP0;
+    const std::uint64_t v2 = std::uint64_t { ntt_prime<kNttP2>::sub(x2, static_cast<std::uint32_t>(low % kNttP2)) } * kNttInvP01 % kNttP2;
+    return low + u128 { v2 } * kNttP01;
+}
+
+bool ntt_fits(size_t an, size_t bn)
+{
+    return 2 * (an + bn) <= kNttMaxLength;
+}
+
+// Convolves the 32-bit halves of a and b modulo three primes and carries
+// the CRT-reconstructed coefficients into r. Requires ntt_fits(an, bn).
+void mul_ntt(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    const size_t rn = an + bn;
+    size_t n = 1;
+    while (n < 2 * rn) {
+        n *= 2;
+    }
+    std::vector<std::uint32_t> c0;
+    std::vector<std::uint32_t> c1;
+    std::vector<std::uint32_t> c2;
+    ntt_prime<kNttP0>::convolve(c0, a, an, b, bn, n);
+    ntt_prime<kNttP1>::convolve(c1, a, an, b, bn, n);
+    ntt_prime<kNttP2>::convolve(c2, a, an, b, bn, n);
+
+    u128 carry = 0;
+    for (size_t i = 0; i < rn; ++i) {
+        carry += crt(c0[2 * i], c1[2 * i], c2[2 * i]);
+        const limb lo = static_cast<std::uint32_t>(carry);
+        carry >>= 32;
+        carry += crt(c0[2 * i + 1], c1[2 * i + 1], c2[2 * i + 1]);
+        r[i] = lo | static_cast<limb>(static_cast<std::uint32_t>(carry)) << 32;
+        carry >>= 32;
+    }
+}
+
+// Handles an >= 2 * bn by multiplying bn-limb slices of a.
+void mul_unbalanced(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    std::fill(r, r + an + bn, 0);
+    std::vector<limb> tmp(2 * bn);
+    for (size_t off = 0; off < an; off += bn) {
+        const size_t n = std::min(bn, an - off);
+        mul_limbs(tmp.data(), a + off, n, b, bn);
+        add_into(r + off, an + bn - off, tmp.data(), n + bn);
+    }
+}
+
+// r[0..an+bn) = a * b; r must not overlap the inputs, which may carry
+// leading zero limbs. a == b with an == bn takes the squaring paths.
+void mul_limbs(limb* r, const limb* a, size_t an, const limb* b, size_t bn)
+{
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    if (bn == 0) {
+        std::fill(r, r + an, 0);
+    } else if (bn < kKaratsubaThreshold) {
+        if (a == b && an == bn) {
+            sqr_basecase(r, a, an);
+        } else {
+            mul_basecase(r, a, an, b, bn);
+        }
+    } else if (bn >= kNttThreshold && ntt_fits(an, bn)) {
+        mul_ntt(r, a, an, b, bn);
+    } else if (an >= 2 * bn) {
+        mul_unbalanced(r, a, an, b, bn);
+    } else if (bn < kToom3Threshold) {
+        mul_karatsuba(r, a, an, b, bn);
+    } else {
+        mul_toom3(r, a, an, b, bn);
+    }
+}
+
+// floor(|x| / B^k) with the sign of x, B = 2^64.
+bigint shifted_down(const bigint& x, size_t k)
+{
+    if (x.size() <= k) {
+        return bigint();
+    }
+    const bigint r = bigint::from_limbs(x.data() + k, x.size() - k);
+    return x.is_negative() ? -r : r;
+}
+
+bigint power_of_b(size_t k)
+{
+    bigint r(1);
+    r <<= 64 * static_cast<std::uint64_t>(k);
+    return r;
+}
+
+bool less_than(const bigint& x, const bigint& y)
+{
+    return cmp(x.data(), x.size(), y.data(), y.size()) < 0;
+}
+
+// B^2k / m, within a few units, for an m > 0 of k limbs: the reciprocal vh
+// of m's top h limbs, scaled to v = vh B^(k-h), is refined by one Newton
+// step v' = v + v (B^2k - m v) / B^2k, which with e = B^(k+h) - m vh comes
+// down to v' = vh B^(k-h) + vh e / B^2h.
+bigint reciprocal(const bigint& m)
+{
+    const size_t k = m.size();
+    if (k <= kNewtonThreshold) {
+        bigint v;
+        divmod(power_of_b(2 * k), m, &v, nullptr);
+        return v;
+    }
+
+    const size_t h = k / 2 + 3;
+    const bigint vh = reciprocal(shifted_down(m, k - h));
+    const bigint e = power_of_b(k + h) - m * vh;
+    bigint v = vh;
+    v <<= 64 * static_cast<std::uint64_t>(k - h);
+    return v + shifted_down(vh * e, 2 * h);
+}
+
+// A divisor m of k limbs with v = reciprocal(m), for Barrett division of
+// numbers below B^2k.
+struct barrett_divisor {
+    bigint m;
+    bigint v;
+};
+
+barrett_divisor make_barrett(bigint m)
+{
+    barrett_divisor d;
+    d.v = reciprocal(m);
+    d.m = std::move(m);
+    return d;
+}
+
+// q = floor(x / m) and r = x mod m for 0 <= x < B^2k. The estimate
+// floor(floor(x / B^(k-1)) v / B^(k+1)) is within a few units of q.
+void barrett_divmod(const bigint& x, const barrett_divisor& d, bigint* q, bigint* r)
+{
+    const size_t k = d.m.size();
+    bigint quot = shifted_down(shifted_down(x, k - 1) * d.v, k + 1);
+    bigint rem = x - quot * d.m;
+    const bigint one(1);
+    while (rem.is_negative()) {
+        rem = rem + d.m;
+        quot = quot - one;
+    }
+    while (!less_than(rem, d.m)) {
+        rem = rem - d.m;
+        quot = quot + one;
+    }
+    *q = std::move(quot);
+    *r = std::move(rem);
+}
+
+// Quotient and remainder of x >= y > 0, y of k limbs: the top k - 1 limbs
+// of x (below y) start the remainder, then the rest of x is brought down in
+// blocks of up to k limbs, each step dividing the remainder and the next
+// block (together below B^2k) with one Barrett division.
+void divmod_newton(const bigint& x, const bigint& y, bigint* q, bigint* r)
+{
+    const size_t k = y.size();
+    const barrett_divisor d = make_barrett(y);
+    size_t pos = x.size() - (k - 1);
+    std::vector<limb> quot(pos);
+    bigint rem = bigint::from_limbs(x.data() + pos, k - 1);
+    while (pos > 0) {
+        const size_t j = std::min(k, pos);
+        pos -= j;
+        rem <<= 64 * static_cast<std::uint64_t>(j);
+        rem = rem + bigint::from_limbs(x.data() + pos, j);
+        bigint qb;
+        barrett_divmod(rem, d, &qb, &rem);
+        std::copy(qb.data(), qb.data() + qb.size(), quot.begin() + static_cast<std::ptrdiff_t>(pos));
+    }
+    *q = bigint::from_limbs(quot.data(), quot.size());
+    *r = std::move(rem);
+}
+
+// Decimal conversion splits numbers at powers[k] = 10^(19 * 2^k).
+size_t decimal_digits(size_t level)
+{
+    return kDecimalBaseDigits << level;
+}
+
+void extend_powers(std::vector<bigint>& powers, size_t levels)
+{
+    if (powers.empty()) {
+        powers.push_back(bigint::from_u64(kDecimalBase));
+    }
+    while (powers.size() < levels) {
+        powers.push_back(powers.back() * powers.back());
+    }
+}
+
+// Writes the n-limb value at p, which is destroyed, as exactly `width`
+// decimal digits, zero-padded on the left.
+void format_basecase(limb* p, size_t n, char* out, size_t width)
+{
+    char* end = out + width;
+    n = trimmed(p, n);
+    while (n > 0) {
+        const limb chunk = divrem_1(p, n, kDecimalBase);
+        n = trimmed(p, n);
+        char digits[kMaxIntChars];
+        const auto len = static_cast<size_t>(format_u64(chunk, digits) - digits);
+        end -= len;
+        std::memcpy(end, digits, len);
+        if (n > 0) {
+            end -= kDecimalBaseDigits - len;
+            std::fill(end, end + (kDecimalBaseDigits - len), '0');
+        }
+    }
+    std::fill(out, end, '0');
+}
+
+// Writes 0 <= x < 10^decimal_digits(level) as exactly that many digits by
+// splitting at powers[level - 1].
+void format_dc(const bigint& x, const std::vector<barrett_divisor>& powers, size_t level, char* out)
+{
+    if (x.size() < kDecimalDcThreshold) {
+        std::vector<limb> tmp(x.data(), x.data() + x.size());
+        format_basecase(tmp.data(), tmp.size(), out, decimal_digits(level));
+        return;
+    }
+    bigint hi;
+    bigint lo;
+    barrett_divmod(x, powers[level - 1], &hi, &lo);
+    format_dc(hi, powers, level - 1, out);
+    format_dc(lo, powers, level - 1, out + decimal_digits(level - 1));
+}
+
+// Value of the decimal digits s[0..n): the low decimal_digits(k) digits and
+// the rest are converted separately and joined with powers[k].
+bigint parse_dc(const char* s, size_t n, std::vector<bigint>& powers)
+{
+    if (n <= kDecimalDcThreshold * kDecimalBaseDigits) {
+        bigint r;
+        // The first chunk takes the leftover digits so the rest are whole.
+        size_t chunk = n % kDecimalBaseDigits;
+        if (chunk == 0) {
+            chunk = kDecimalBaseDigits;
+        }
+        for (size_t i = 0; i < n;) {
+            limb v = 0;
+            limb scale = 1;
+            for (size_t k = 0; k < chunk; ++k) {
+                v = v * 10 + static_cast<limb>(s[i + k] - '0');
+                scale *= 10;
+            }
+            r *= scale;
+            r = r + bigint::from_u64(v);
+            i += chunk;
+            chunk = kDecimalBaseDigits;
+        }
+        return r;
+    }
+    size_t k = 0;
+    while (decimal_digits(k + 1) < n) {
+        ++k;
+    }
+    extend_powers(powers, k + 1);
+    const size_t lo_n = decimal_digits(k);
+    const bigint hi = parse_dc(s, n - lo_n, powers);
+    return hi * powers[k] + parse_dc(s + n - lo_n, lo_n, powers);
+}
+
+// |x| / 2^s for the largest such power of two; x must not be zero.
+bigint odd_part(const bigint& x, std::uint64_t* s)
+{
+    size_t z = 0;
+    while (x.data()[z] == 0) {
+        ++z;
+    }
+    const auto bits = static_cast<unsigned>(__builtin_ctzll(x.data()[z]));
+    *s = 64 * static_cast<std::uint64_t>(z) + bits;
+
+    std::vector<limb> v(x.data() + z, x.data() + x.size());
+    if (bits != 0) {
+        for (size_t i = 0; i < v.size(); ++i) {
+            const limb next = i + 1 < v.size() ? v[i + 1] << (64 - bits) : 0;
+            v[i] = (v[i] >> bits) | next;
+        }
+    }
+    return bigint::from_limbs(v.data(), v.size());
+}
+
+// x^e for e > 0 by left-to-right sliding windows: the odd powers x, x^3,
+// ..., x^(2^w - 1) are precomputed, so each run of up to w exponent bits
+// that ends in a one costs a single multiplication after its squarings.
+bigint pow_window(const bigint& x, std::uint64_t e)
+{
+    const int top = 63 - __builtin_clzll(e);
+    const int w = top < 8 ? 1 : top < 24 ? 3 : 4;
+    std::vector<bigint> odd(size_t { 1 } << (w - 1));
+    odd[0] = x;
+    if (w > 1) {
+        const bigint x2 = x * x;
+        for (size_t i = 1; i < odd.size(); ++i) {
+            odd[i] = odd[i - 1] * x2;
+        }
+    }
+
+    bigint r;
+    bool first = true;
+    for (int i = top; i >= 0;) {
+        if (((e >> i) & 1) == 0) {
+            r = r * r;
+            --i;
+            continue;
+        }
+        int j = std::max(i - w + 1, 0);
+        while (((e >> j) & 1) == 0) {
+            ++j;
+        }
+        const auto window = static_cast<size_t>((e >> j) & ((std::uint64_t { 2 } << (i - j)) - 1));
+        if (first) {
+            r = odd[window / 2];
+            first = false;
+        } else {
+            for (int k = j; k <= i; ++k) {
+                r = r * r;
+            }
+            r = r * odd[window / 2];
+        }
+        i = j - 1;
+    }
+    return r;
+}
+
+// Residues modulo an odd m of n limbs in Montgomery form x R mod m,
+// R = B^n, each stored as exactly n limbs. A product is reduced by n steps
+// that each add a multiple of m clearing the lowest limb (REDC), which is
+// cheaper than a division.
+class montgomery_ring {
+public:
+    explicit montgomery_ring(const bigint& m)
+        : m_(m.data(), m.data() + m.size())
+        , n_(m.size())
+        , t_(2 * n_ + 1)
+    {
+        // Newton's iteration for m[0]^-1 mod 2^64, then negated.
+        limb inv = m_[0];
+        for (int i = 0; i < 5; ++i) {
+            inv *= 2 - m_[0] * inv;
+        }
+        minv_ = 0 - inv;
+    }
+
+    using residue = std::vector<limb>;
+
+    // x R mod m for 0 <= x < m.
+    residue to(const bigint& x, const bigint& m) const
+    {
+        bigint shifted = x;
+        shifted <<= 64 * static_cast<std::uint64_t>(n_);
+        bigint r;
+        divmod(shifted, m, nullptr, &r);
+        return widened(r);
+    }
+
+    bigint from(const residue& x)
+    {
+        std::fill(t_.begin(), t_.end(), 0);
+        std::copy(x.begin(), x.end(), t_.begin());
+        residue r(n_);
+        redc(r.data());
+        return bigint::from_limbs(r.data(), n_);
+    }
+
+    residue one(const bigint& m) const { return to(bigint(1), m); }
+
+    void mul(residue& r, const residue& x, const residue& y)
+    {
+        mul_limbs(t_.data(), x.data(), n_, y.data(), n_);
+        t_[2 * n_] = 0;
+        redc(r.data());
+    }
+
+private:
+    residue widened(const bigint& x) const
+    {
+        residue r(n_);
+        std::copy(x.data(), x.data() + x.size(), r.begin());
+        return r;
+    }
+
+    // r = t_ R^-1 mod m for t_ < m R, consuming t_.
+    void redc(limb* r)
+    {
+        limb* t = t_.data();
+        for (size_t i = 0; i < n_; ++i) {
+            limb carry = addmul_1(t + i, m_.data(), n_, t[i] * minv_);
+            for (size_t j = i + n_; carry != 0; ++j) {
+                t[j] += carry;
+                carry = static_cast<limb>(t[j] < carry);
+            }
+        }
+        // t / R < 2m here, so one subtraction suffices.
+        if (t[2 * n_] != 0 || cmp_n(t + n_, m_.data(), n_) >= 0) {
+            sub(r, t + n_, n_, m_.data(), n_);
+        } else {
+            std::copy(t + n_, t + 2 * n_, r);
+        }
+    }
+
+    std::vector<limb> m_;
+    size_t n_;
+    limb minv_ = 0;
+    std::vector<limb> t_;
+};
+
+// Residues modulo any m > 0 as plain bigints, reduced by Barrett division
+// with a reciprocal computed once.
+class barrett_ring {
+public:
+    explicit barrett_ring(const bigint& m)
+        : d_(make_barrett(m))
+    {
+    }
+
+    using residue = bigint;
+
+    residue to(const bigint& x, const bigint&) const { return x; }
+    bigint from(const residue& x) const { return x; }
+    residue one(const bigint& m) const { return m == bigint(1) ? bigint() : bigint(1); }
+
+    void mul(residue& r, const residue& x, const residue& y) const
+    {
+        bigint q;
+        barrett_divmod(x * y, d_, &q, &r);
+    }
+
+private:
+    barrett_divisor d_;
+};
+
+bool exponent_bit(const bigint& e, size_t i)
+{
+    return ((e.data()[i / 64] >> (i % 64)) & 1) != 0;
+}
+
+// x^e mod m for 0 <= x < m and e >= 0 by left-to-right sliding windows over
+// the bits of e, as in pow_window(), with every product reduced in `ring`.
+template <typename Ring>
+bigint powmod_window(Ring& ring, const bigint& x, const bigint& e, const bigint& m)
+{
+    using residue = typename Ring::residue;
+    residue r = ring.one(m);
+    const size_t bits = e.bit_length();
+    if (bits == 0) {
+        return ring.from(r);
+    }
+    const size_t w = bits < 8 ? 1 : bits < 24 ? 3 : bits < 80 ? 4 : bits < 240 ? 5 : 6;
+    std::vector<residue> odd(size_t { 1 } << (w - 1));
+    odd[0] = ring.to(x, m);
+    if (w > 1) {
+        residue x2 = odd[0];
+        ring.mul(x2, odd[0], odd[0]);
+        for (size_t i = 1; i < odd.size(); ++i) {
+            odd[i] = odd[0];
+            ring.mul(odd[i], odd[i - 1], x2);
+        }
+    }
+
+    bool first = true;
+    for (size_t i = bits; i-- > 0;) {
+        if (!exponent_bit(e, i)) {
+            ring.mul(r, r, r);
+            continue;
+        }
+        size_t j = i + 1 > w ? i + 1 - w : 0;
+        while (!exponent_bit(e, j)) {
+            ++j;
+        }
+        size_t window = 0;
+        for (size_t k = i + 1; k-- > j;) {
+            window = 2 * window + (exponent_bit(e, k) ? 1 : 0);
+        }
+        if (first) {
+            r = odd[window / 2];
+            first = false;
+        } else {
+            for (size_t k = j; k <= i; ++k) {
+                ring.mul(r, r, r);
+            }
+            ring.mul(r, r, odd[window / 2]);
+        }
+        i = j;
+    }
+    return ring.from(r);
+}
+
+bigint product(const limb* f, size_t n)
+{
+    if (n <= kProductLeaf) {
+        bigint r(1);
+        for (size_t i = 0; i < n; ++i) {
+            r *= f[i];
+        }
+        return r;
+    }
+    const size_t half = n / 2;
+    return product(f, half) * product(f + half, n - half);
+}
+
+// Odd numbers 3, 5, ..., n: is_composite[i] describes 2i + 1.
+std::vector<bool> sieve_odd(std::uint64_t n)
+{
+    std::vector<bool> is_composite(static_cast<size_t>(n / 2 + 1), false);
+    for (std::uint64_t p = 3; p * p <= n; p += 2) {
+        if (is_composite[p / 2]) {
+            continue;
+        }
+        for (std::uint64_t q = p * p; q <= n; q += 2 * p) {
+            is_composite[q / 2] = true;
+        }
+    }
+    return is_composite;
+}
+
+// Odd part of the swing number n! / ((n/2)!)^2: each odd prime p <= n
+// appears with the exponent sum over k of floor(n / p^k) mod 2, and p^e <= n
+// always holds, so every factor fits in a limb. Factors are packed several
+// to a limb before the product tree.
+bigint odd_swing(std::uint64_t n, const std::vector<bool>& is_composite)
+{
+    std::vector<limb> factors;
+    limb acc = 1;
+    for (std::uint64_t p = 3; p <= n; p += 2) {
+        if (is_composite[p / 2]) {
+            continue;
+        }
+        limb pe = 1;
+        for (std::uint64_t q = n / p; q > 0; q /= p) {
+            if ((q & 1) != 0) {
+                pe *= p;
+            }
+        }
+        if (pe == 1) {
+            continue;
+        }
+        if (static_cast<u128>(acc) * pe > ~limb { 0 }) {
+            factors.push_back(acc);
+            acc = 1;
+        }
+        acc *= pe;
+    }
+    factors.push_back(acc);
+    return product(factors.data(), factors.size());
+}
+
+// Odd part of n!: oddfact(n) = oddfact(n/2)^2 * odd_swing(n).
+bigint odd_factorial(std::uint64_t n, const std::vector<bool>& is_composite)
+{
+    if (n < 3) {
+        return bigint(1);
+    }
+    const bigint half = odd_factorial(n / 2, is_composite);
+    return half * half * odd_swing(n, is_composite);
+}
+
+// Prime factorization of C(n, k) by Legendre's formula: an odd prime p
+// divides it sum over i of floor(n / p^i) - floor(k / p^i) - floor((n - k) /
+// p^i) times, and that power of p never exceeds n, so each fits in a limb.
+// The power of two, the number of carries when adding k and n - k in base
+// 2, is applied as a shift.
+bigint binomial_legendre(std::uint64_t n, std::uint64_t k)
+{
+    const std::vector<bool> is_composite = sieve_odd(n);
+    const std::uint64_t nk = n - k;
+    std::vector<limb> factors;
+    limb acc = 1;
+    for (std::uint64_t p = 3; p <= n; p += 2) {
+        if (is_composite[p / 2]) {
+            continue;
+        }
+        limb pe = 1;
+        for (std::uint64_t q = p;; q *= p) {
+            for (std::uint64_t e = n / q - k / q - nk / q; e > 0; --e) {
+                pe *= p;
+            }
+            if (q > n / p) {
+                break;
+            }
+        }
+        if (pe == 1) {
+            continue;
+        }
+        if (static_cast<u128>(acc) * pe > ~limb { 0 }) {
+            factors.push_back(acc);
+            acc = 1;
+        }
+        acc *= pe;
+    }
+    factors.push_back(acc);
+    bigint r = product(factors.data(), factors.size());
+    r <<= static_cast<std::uint64_t>(__builtin_popcountll(k) + __builtin_popcountll(nk) - __builtin_popcountll(n));
+    return r;
+}
+
+} // namespace
+
+limb_vector::limb_vector(const limb_vector& other)
+{
+    reserve(other.size_);
+    std::memcpy(data(), other.data(), other.size_ * sizeof(limb));
+    size_ = other.size_;
+}
+
+limb_vector::limb_vector(limb_vector&& other) noexcept
+    : size_(other.size_)
+    , cap_(other.cap_)
+{
+    if (other.heap()) {
+        heap_ = other.heap_;
+        other.cap_ = kInline;
+    } else {
+        std::memcpy(inline_, other.inline_, sizeof(inline_));
+    }
+    other.size_ = 0;
+}
+
+limb_vector& limb_vector::operator=(const limb_vector& other)
+{
+    if (this != &other) {
+        size_ = 0;
+        reserve(other.size_);
+        std::memcpy(data(), other.data(), other.size_ * sizeof(limb));
+        size_ = other.size_;
+    }
+    return *this;
+}
+
+limb_vector& limb_vector::operator=(limb_vector&& other) noexcept
+{
+    if (this != &other) {
+        if (heap()) {
+            delete[] heap_;
+        }
+        size_ = other.size_;
+        cap_ = other.cap_;
+        if (other.heap()) {
+            heap_ = other.heap_;
+            other.cap_ = kInline;
+        } else {
+            std::memcpy(inline_, other.inline_, sizeof(inline_));
+        }
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+limb_vector::~limb_vector()
+{
+    if (heap()) {
+        delete[] heap_;
+    }
+}
+
+void limb_vector::reserve(size_t n)
+{
+    if (n <= cap_) {
+        return;
+    }
+    size_t cap = static_cast<size_t>(cap_) * 2;
+    if (cap < n) {
+        cap = n;
+    }
+    if (cap > UINT32_MAX) {
+        throw std::bad_alloc();
+    }
+    auto* fresh = new limb[cap];
+    std::memcpy(fresh, data(), size_ * sizeof(limb));
+    if (heap()) {
+        delete[] heap_;
+    }
+    heap_ = fresh;
+    cap_ = static_cast<std::uint32_t>(cap);
+}
+
+void limb_vector::resize(size_t n)
+{
+    reserve(n);
+    if (n > size_) {
+        std::memset(data() + size_, 0, (n - size_) * sizeof(limb));
+    }
+    size_ = static_cast<std::uint32_t>(n);
+}
+
+void limb_vector::push_back(limb v)
+{
+    reserve(static_cast<size_t>(size_) + 1);
+    data()[size_++] = v;
+}
+
+void limb_vector::insert_low(size_t n)
+{
+    if (n == 0 || size_ == 0) {
+        return;
+    }
+    const size_t old = size_;
+    resize(old + n);
+    limb* p = data();
+    std::memmove(p + n, p, old * sizeof(limb));
+    std::memset(p, 0, n * sizeof(limb));
+}
+
+bigint::bigint(std::int64_t v)
+{
+    if (v != 0) {
+        neg_ = v < 0;
+        mag_.push_back(neg_ ? 0 - static_cast<limb>(v) : static_cast<limb>(v));
+    }
+}
+
+bigint bigint::from_u64(std::uint64_t v)
+{
+    bigint r;
+    if (v != 0) {
+        r.mag_.push_back(v);
+    }
+    return r;
+}
+
+bigint bigint::from_limbs(const limb* p, size_t n)
+{
+    bigint r;
+    n = trimmed(p, n);
+    r.mag_.resize(n);
+    std::memcpy(r.mag_.data(), p, n * sizeof(limb));
+    return r;
+}
+
+bool bigint::parse(const char* s, size_t n, bigint* out)
+{
+    if (!s || !out) {
+        return false;
+    }
+
+    size_t i = 0;
+    while (i < n && (s[i] == ' ' || (s[i] >= '\t' && s[i] <= '\r'))) {
+        ++i;
+    }
+    bool negative = false;
+    if (i < n && (s[i] == '+' || s[i] == '-')) {
+        negative = s[i] == '-';
+        ++i;
+    }
+    if (i == n) {
+        return false;
+    }
+    for (size_t k = i; k < n; ++k) {
+        if (s[k] < '0' || s[k] > '9') {
+            return false;
+        }
+    }
+
+    std::vector<bigint> powers;
+    bigint r = parse_dc(s + i, n - i, powers);
+    r.neg_ = negative && !r.is_zero();
+    *out = std::move(r);
+    return true;
+}
+
+bool bigint::to_u64(std::uint64_t* out) const
+{
+    if (neg_ || size() > 1) {
+        return false;
+    }
+    *out = is_zero() ? 0 : mag_[0];
+    return true;
+}
+
+size_t bigint::bit_length() const
+{
+    if (is_zero()) {
+        return 0;
+    }
+    return size() * 64 - static_cast<size_t>(__builtin_clzll(mag_.back()));
+}
+
+void bigint::trim()
+{
+    while (!mag_.empty() && mag_.back() == 0) {
+        mag_.pop_back();
+    }
+    if (mag_.empty()) {
+        neg_ = false;
+    }
+}
+
+bigint bigint::operator-() const
+{
+    bigint r = *this;
+    r.neg_ = !r.is_zero() && !neg_;
+    return r;
+}
+
+bigint& bigint::operator*=(std::uint64_t m)
+{
+    if (m == 0 || is_zero()) {
+        mag_.clear();
+        neg_ = false;
+        return *this;
+    }
+    const limb carry = mul_1(mag_.data(), mag_.data(), mag_.size(), m);
+    if (carry != 0) {
+        mag_.push_back(carry);
+    }
+    return *this;
+}
+
+bigint& bigint::operator<<=(std::uint64_t bits)
+{
+    if (is_zero() || bits == 0) {
+        return *this;
+    }
+    const auto whole = static_cast<size_t>(bits / 64);
+    const auto part = static_cast<unsigned>(bits % 64);
+    if (part != 0) {
+        limb carry = 0;
+        limb* p = mag_.data();
+        for (size_t i = 0; i < mag_.size(); ++i) {
+            const limb next = p[i] >> (64 - part);
+            p[i] = (p[i] << part) | carry;
+            carry = next;
+        }
+        if (carry != 0) {
+            mag_.push_back(carry);
+        }
+    }
+    mag_.insert_low(whole);
+    return *this;
+}
+
+bigint operator+(const bigint& x, const bigint& y)
+{
+    if (x.size() < y.size()) {
+        return y + x;
+    }
+
+    bigint r;
+    if (x.neg_ == y.neg_) {
+        r.mag_.resize(x.size() + 1);
+        r.mag_[x.size()] = add(r.mag_.data(), x.data(), x.size(), y.data(), y.size());
+        r.neg_ = x.neg_;
+    } else if (cmp(x.data(), x.size(), y.data(), y.size()) >= 0) {
+        r.mag_.resize(x.size());
+        sub(r.mag_.data(), x.data(), x.size(), y.data(), y.size());
+        r.neg_ = x.neg_;
+    } else {
+        r.mag_.resize(y.size());
+        sub(r.mag_.data(), y.data(), y.size(), x.data(), x.size());
+        r.neg_ = y.neg_;
+    }
+    r.trim();
+    return r;
+}
+
+bigint operator-(const bigint& x, const bigint& y)
+{
+    return x + -y;
+}
+
+bigint operator*(const bigint& x, const bigint& y)
+{
+    return mul_with(x, y, mul_algorithm::automatic);
+}
+
+bigint mul_with(const bigint& x, const bigint& y, mul_algorithm top)
+{
+    bigint r;
+    if (x.is_zero() || y.is_zero()) {
+        return r;
+    }
+    const bigint& a = x.size() >= y.size() ? x : y;
+    const bigint& b = x.size() >= y.size() ? y : x;
+    r.mag_.resize(a.size() + b.size());
+    limb* p = r.mag_.data();
+    switch (top) {
+    case mul_algorithm::basecase:
+        mul_basecase(p, a.data(), a.size(), b.data(), b.size());
+        break;
+    case mul_algorithm::karatsuba:
+        mul_karatsuba(p, a.data(), a.size(), b.data(), b.size());
+        break;
+    case mul_algorithm::toom3:
+        mul_toom3(p, a.data(), a.size(), b.data(), b.size());
+        break;
+    case mul_algorithm::ntt:
+        if (ntt_fits(a.size(), b.size())) {
+            mul_ntt(p, a.data(), a.size(), b.data(), b.size());
+        } else {
+            mul_limbs(p, a.data(), a.size(), b.data(), b.size());
+        }
+        break;
+    case mul_algorithm::automatic:
+    default:
+        mul_limbs(p, a.data(), a.size(), b.data(), b.size());
+        break;
+    }
+    r.neg_ = x.neg_ != y.neg_;
+    r.trim();
+    return r;
+}
+
+bool operator==(const bigint& x, const bigint& y)
+{
+    return x.neg_ == y.neg_ && cmp(x.data(), x.size(), y.data(), y.size()) == 0;
+}
+
+bool divmod(const bigint& x, const bigint& y, bigint* q, bigint* r)
+{
+    if (y.is_zero()) {
+        return false;
+    }
+
+    bigint quot;
+    bigint rem;
+    if (cmp(x.data(), x.size(), y.data(), y.size()) < 0) {
+        rem = x;
+    } else if (y.size() == 1) {
+        quot.mag_ = x.mag_;
+        rem = bigint::from_u64(divrem_1(quot.mag_.data(), quot.size(), y.mag_[0]));
+    } else if (y.size() >= kDivNewtonThreshold && x.size() - y.size() >= kDivNewtonThreshold) {
+        divmod_newton(bigint::from_limbs(x.data(), x.size()), bigint::from_limbs(y.data(), y.size()), &quot, &rem);
+    } else {
+        const auto shift = static_cast<unsigned>(__builtin_clzll(y.mag_.back()));
+        bigint u = x;
+        bigint v = y;
+        u <<= shift;
+        v <<= shift;
+        u.mag_.resize(x.size() + 1);
+
+        quot.mag_.resize(x.size() - y.size() + 1);
+        divrem_knuth(quot.mag_.data(), u.mag_.data(), x.size(), v.data(), v.size());
+
+        u.mag_.resize(y.size());
+        if (shift != 0) {
+            limb* p = u.mag_.data();
+            for (size_t i = 0; i + 1 < y.size(); ++i) {
+                p[i] = (p[i] >> shift) | (p[i + 1] << (64 - shift));
+            }
+            p[y.size() - 1] >>= shift;
+        }
+        rem.mag_ = std::move(u.mag_);
+    }
+
+    quot.neg_ = x.neg_ != y.neg_;
+    quot.trim();
+    rem.neg_ = x.neg_;
+    rem.trim();
+    if (q) {
+        *q = std::move(quot);
+    }
+    if (r) {
+        *r = std::move(rem);
+    }
+    return true;
+}
+
+std::string bigint::to_string() const
+{
+    if (is_zero()) {
+        return "0";
+    }
+
+    // Format into a zero-padded field wide enough for the magnitude, then
+    // drop the padding.
+    std::string s(1, '-');
+    if (size() < kToStringDcThreshold) {
+        std::vector<limb> tmp(mag_.data(), mag_.data() + mag_.size());
+        s.resize(1 + size() * kMaxIntChars);
+        format_basecase(tmp.data(), tmp.size(), &s[1], size() * kMaxIntChars);
+    } else {
+        const bigint x = bigint::from_limbs(data(), size());
+        std::vector<bigint> powers;
+        extend_powers(powers, 1);
+        while (!less_than(x, powers.back())) {
+            extend_powers(powers, powers.size() + 1);
+        }
+        const size_t level = powers.size() - 1;
+        std::vector<barrett_divisor> divisors;
+        for (size_t k = 0; k < level; ++k) {
+            divisors.push_back(make_barrett(std::move(powers[k])));
+        }
+        s.resize(1 + decimal_digits(level));
+        format_dc(x, divisors, level, &s[1]);
+    }
+
+    const size_t zeros = s.find_first_not_of('0', 1) - 1;
+    s.erase(neg_ ? 1 : 0, neg_ ? zeros : zeros + 1);
+    return s;
+}
+
+std::string bigint::to_hex() const
+{
+    if (is_zero()) {
+        return "0";
+    }
+
+    std::string s(1 + kMaxHexChars * size(), '-');
+    char* p = neg_ ? &s[1] : &s[0];
+    p = format_hex_u64(mag_.back(), p);
+    for (size_t i = size() - 1; i-- > 0;) {
+        limb v = mag_[i];
+        for (size_t k = kMaxHexChars; k-- > 0;) {
+            p[k] = "0123456789abcdef"[v & 0xf];
+            v >>= 4;
+        }
+        p += kMaxHexChars;
+    }
+    s.resize(static_cast<size_t>(p - s.data()));
+    return s;
+}
+
+bool factorial(std::uint64_t n, bigint* out)
+{
+    // log2(n!) before sieving up to n, which alone would not fit in memory
+    // long before the result hits the limit.
+    const double bits = std::lgamma(static_cast<double>(n) + 1) / std::log(2.0);
+    if (bits > static_cast<double>(kMaxBigintBits)) {
+        return false;
+    }
+    const std::vector<bool> is_composite = sieve_odd(n);
+    *out = odd_factorial(n, is_composite);
+    // The exponent of two in n! is n - popcount(n).
+    *out <<= n - static_cast<std::uint64_t>(__builtin_popcountll(n));
+    return true;
+}
+
+bool binomial(std::uint64_t n, std::uint64_t k, bigint* out)
+{
+    if (k > n) {
+        *out = bigint();
+        return true;
+    }
+    k = std::min(k, n - k);
+    if (k == 0) {
+        *out = bigint(1);
+        return true;
+    }
+    const double bits = (std::lgamma(static_cast<double>(n) + 1) - std::lgamma(static_cast<double>(k) + 1)
+                            - std::lgamma(static_cast<double>(n - k) + 1))
+        / std::log(2.0);
+    if (bits > static_cast<double>(kMaxBigintBits)) {
+        return false;
+    }
+
+    if (n / k <= kBinomialLegendreRatio && n <= kBinomialSieveMax) {
+        *out = binomial_legendre(n, k);
+        return true;
+    }
+    // The numerator outgrows the result by up to k log2(n / k) bits.
+    const auto n_bits = static_cast<std::uint64_t>(64 - __builtin_clzll(n));
+    if (static_cast<u128>(k) * n_bits > kMaxBigintBits) {
+        return false;
+    }
+    std::vector<limb> numerator;
+    limb acc = 1;
+    for (std::uint64_t f = n - k + 1; f <= n && f != 0; ++f) {
+        if (static_cast<u128>(acc) * f > ~limb { 0 }) {
+            numerator.push_back(acc);
+            acc = 1;
+        }
+        acc *= f;
+    }
+    numerator.push_back(acc);
+    // k! is smaller than the numerator, which passed the limit above.
+    bigint k_factorial;
+    factorial(k, &k_factorial);
+    divmod(product(numerator.data(), numerator.size()), k_factorial, out, nullptr);
+    return true;
+}
+
+bool pow(const bigint& x, std::uint64_t e, bigint* out)
+{
+    if (e == 0) {
+        *out = bigint(1);
+        return true;
+    }
+    const size_t bits = x.bit_length();
+    if (bits > 1 && static_cast<u128>(bits) * e > kMaxBigintBits) {
+        return false;
+    }
+    if (x.is_zero()) {
+        *out = bigint();
+        return true;
+    }
+
+    // x = odd 2^s, so x^e = odd^e 2^(s e): powers of two are a single shift.
+    std::uint64_t s = 0;
+    bigint r = pow_window(odd_part(x, &s), e);
+    r <<= s * e;
+    *out = x.is_negative() && (e & 1) != 0 ? -r : std::move(r);
+    return true;
+}
+
+bool powmod(const bigint& x, const bigint& e, const bigint& m, bigint* out)
+{
+    if (e.is_negative() || m.is_negative() || m.is_zero()) {
+        return false;
+    }
+    bigint base;
+    divmod(x, m, nullptr, &base);
+    if (base.is_negative()) {
+        base = base + m;
+    }
+    if ((m.data()[0] & 1) != 0) {
+        montgomery_ring ring(m);
+        *out = powmod_window(ring, base, e, m);
+    } else {
+        barrett_ring ring(m);
+        *out = powmod_window(ring, base, e, m);
+    }
+    return true;
+}
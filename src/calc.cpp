@@ -0,0 +1,486 @@
+#include <calc.h>
+#include <modarith.h>
+#include <primes.h>
+#include <sieve.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+constexpr size_t kMaxI64Digits = 19;
+constexpr std::uint64_t kI64MinMagnitude = std::uint64_t { 1 } << 63;
+
+// Same set as isspace() in the "C" locale, which calc never changes.
+bool is_c_space(char ch)
+{
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+bool is_digit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+// SWAR helpers: eight ASCII bytes are validated and converted as one 64-bit
+// word. The byte order of the load matters, so big-endian hosts take the
+// byte-at-a-time loop instead.
+std::uint64_t load8(const char* p)
+{
+    std::uint64_t v = 0;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool is_eight_digits(const char* p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const std::uint64_t v = load8(p);
+    return ((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        == 0x3333333333333333ULL;
+#else
+    (void)p;
+    return false;
+#endif
+}
+
+// Requires is_eight_digits(p); the first byte is the most significant digit.
+std::uint32_t parse_eight_digits(const char* p)
+{
+    std::uint64_t v = load8(p) - 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+            + (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))))
+        >> 32;
+    return static_cast<std::uint32_t>(v);
+}
+
+exit_code calc_big(context& c)
+{
+    c.r = mathlib::ml_result {};
+    c.r.error = mathlib::ml_error::ok;
+
+    switch (c.op) {
+    case operation::add: {
+        c.big_r = c.big_a + c.big_b;
+        break;
+    }
+    case operation::sub: {
+        c.big_r = c.big_a - c.big_b;
+        break;
+    }
+    case operation::mul:
+    case operation::bigmul: {
+        c.big_r = c.big_a * c.big_b;
+        break;
+    }
+    case operation::div: {
+        if (!divmod(c.big_a, c.big_b, &c.big_r, nullptr)) {
+            c.r.error = mathlib::ml_error::div0;
+        }
+        break;
+    }
+    case operation::mod: {
+        if (!divmod(c.big_a, c.big_b, nullptr, &c.big_r)) {
+            c.r.error = mathlib::ml_error::div0;
+        }
+        break;
+    }
+    case operation::divmod: {
+        if (!divmod(c.big_a, c.big_b, &c.big_r, &c.big_r2)) {
+            c.r.error = mathlib::ml_error::div0;
+        }
+        break;
+    }
+    case operation::pow:
+    case operation::bigpow: {
+        std::uint64_t e = 0;
+        if (!c.big_b.to_u64(&e)) {
+            if (c.big_a.bit_length() > 1) {
+                c.r.error = mathlib::ml_error::overflow;
+                break;
+            }
+            // |a| <= 1: only the parity of b matters.
+            e = 2 + (c.big_b.data()[0] & 1);
+        }
+        if (!pow(c.big_a, e, &c.big_r)) {
+            c.r.error = mathlib::ml_error::overflow;
+        }
+        break;
+    }
+    case operation::powmod: {
+        // Moduli and exponents of one limb take the 128-bit fast paths.
+        std::uint64_t m = 0;
+        std::uint64_t e = 0;
+        if (c.big_m.to_u64(&m) && c.big_b.to_u64(&e)) {
+            bigint a;
+            divmod(c.big_a, c.big_m, nullptr, &a);
+            if (a.is_negative()) {
+                a = a + c.big_m;
+            }
+            std::uint64_t x = 0;
+            a.to_u64(&x);
+            c.big_r = bigint::from_u64(powmod_u64(x, e, m));
+        } else {
+            powmod(c.big_a, c.big_b, c.big_m, &c.big_r);
+        }
+        break;
+    }
+    case operation::isprime: {
+        // The test is deterministic for 64-bit values only.
+        std::uint64_t n = 0;
+        if (c.big_a.is_negative()) {
+            c.big_r = bigint(0);
+        } else if (c.big_a.to_u64(&n)) {
+            c.big_r = bigint(is_prime_u64(n) ? 1 : 0);
+        } else {
+            c.r.error = mathlib::ml_error::overflow;
+        }
+        break;
+    }
+    case operation::factor: {
+        std::uint64_t n = 0;
+        if (!c.big_a.to_u64(&n)) {
+            c.r.error = mathlib::ml_error::overflow;
+            break;
+        }
+        c.factors = factor_u64(n);
+        break;
+    }
+    case operation::primecount: {
+        std::uint64_t a = 0;
+        std::uint64_t b = 0;
+        sieve_range(c, &a, &b);
+        c.big_r = bigint::from_u64(count_primes(a, b, c.threads));
+        break;
+    }
+    case operation::binom: {
+        std::uint64_t n = 0;
+        std::uint64_t k = 0;
+        if (!c.big_a.to_u64(&n)) {
+            c.r.error = mathlib::ml_error::overflow;
+            break;
+        }
+        if (!c.big_b.to_u64(&k) || k > n) {
+            c.big_r = bigint();
+            break;
+        }
+        if (!binomial(n, k, &c.big_r)) {
+            c.r.error = mathlib::ml_error::overflow;
+        }
+        break;
+    }
+    case operation::fact: {
+        std::uint64_t n = 0;
+        if (!c.big_a.to_u64(&n)) {
+            c.r.error = mathlib::ml_error::overflow;
+            break;
+        }
+        if (!factorial(n, &c.big_r)) {
+            c.r.error = mathlib::ml_error::overflow;
+        }
+        break;
+    }
+    case operation::none:
+    default: {
+        std::fprintf(stderr, "Error: unknown operation\n");
+        return exit_code::usage;
+    }
+    }
+    return exit_code::ok;
+}
+
+} // namespace
+
+bool needs_b(operation op)
+{
+    return op == operation::add || op == operation::sub || op == operation::mul || op == operation::div || op == operation::pow
+        || op == operation::bigmul || op == operation::mod || op == operation::divmod || op == operation::bigpow
+        || op == operation::powmod || op == operation::primecount || op == operation::primes || op == operation::binom;
+}
+
+bool needs_m(operation op)
+{
+    return op == operation::powmod;
+}
+
+bool is_big_op(operation op)
+{
+    return op == operation::bigmul || op == operation::bigpow;
+}
+
+bool parse_i64(const char* s, std::int64_t* out)
+{
+    if (!s) {
+        return false;
+    }
+    return parse_i64(s, std::strlen(s), out);
+}
+
+bool parse_op(const char* s, operation* out)
+{
+    if (!s || !out) {
+        return false;
+    }
+    for (size_t i = 0; i < kOpsCount; ++i) {
+        if (std::strcmp(s, kOps[i].name) == 0) {
+            *out = kOps[i].op;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_i64(const char* s, size_t n, std::int64_t* out)
+{
+    if (!s || !out) {
+        return false;
+    }
+
+    size_t i = 0;
+    while (i < n && is_c_space(s[i])) {
+        ++i;
+    }
+    bool negative = false;
+    if (i < n && (s[i] == '+' || s[i] == '-')) {
+        negative = s[i] == '-';
+        ++i;
+    }
+
+    const size_t digits_start = i;
+    while (i < n && s[i] == '0') {
+        ++i;
+    }
+
+    // Without leading zeros, 19 digits always fit in u64 and 20 never fit in
+    // i64, so the accumulator cannot wrap before the range check below.
+    std::uint64_t v = 0;
+    const size_t significant_start = i;
+    while (n - i >= 8 && i - significant_start + 8 <= kMaxI64Digits && is_eight_digits(s + i)) {
+        v = v * 100000000 + parse_eight_digits(s + i);
+        i += 8;
+    }
+    while (i < n && is_digit(s[i])) {
+        if (i - significant_start == kMaxI64Digits) {
+            return false;
+        }
+        v = v * 10 + static_cast<std::uint64_t>(s[i] - '0');
+        ++i;
+    }
+
+    if (i == digits_start || i != n) {
+        return false;
+    }
+
+    const std::uint64_t limit = negative ? kI64MinMagnitude : kI64MinMagnitude - 1;
+    if (v > limit) {
+        return false;
+    }
+    *out = negative ? static_cast<std::int64_t>(0 - v) : static_cast<std::int64_t>(v);
+    return true;
+}
+
+bool parse_op(const char* s, size_t n, operation* out)
+{
+    if (!s || !out) {
+        return false;
+    }
+    for (size_t i = 0; i < kOpsCount; ++i) {
+        if (std::strlen(kOps[i].name) == n && std::memcmp(s, kOps[i].name, n) == 0) {
+            *out = kOps[i].op;
+            return true;
+        }
+    }
+    return false;
+}
+
+check_error validate(const context& c)
+{
+    if (!c.have_op || !c.have_a) {
+        return check_error::missing_operand;
+    }
+    if (!needs_b(c.op) && c.have_b) {
+        return check_error::useless_b;
+    }
+    if (needs_b(c.op) && !c.have_b) {
+        return check_error::missing_b;
+    }
+    if ((c.op == operation::pow || c.op == operation::bigpow) && (c.big ? c.big_b.is_negative() : c.b < 0)) {
+        return check_error::pow_domain;
+    }
+    if (c.op == operation::fact && (c.big ? c.big_a.is_negative() : c.a < 0)) {
+        return check_error::fact_domain;
+    }
+    if (c.op == operation::factor && (c.big ? c.big_a.is_negative() || c.big_a.is_zero() : c.a < 1)) {
+        return check_error::factor_domain;
+    }
+    if (c.op == operation::binom
+        && (c.big ? c.big_a.is_negative() || c.big_b.is_negative() : c.a < 0 || c.b < 0)) {
+        return check_error::binom_domain;
+    }
+    if (c.op == operation::primecount || c.op == operation::primes) {
+        std::uint64_t a = 0;
+        std::uint64_t b = 0;
+        if (!sieve_range(c, &a, &b)) {
+            return check_error::sieve_domain;
+        }
+    }
+    if (!needs_m(c.op) && c.have_m) {
+        return check_error::useless_m;
+    }
+    if (needs_m(c.op) && !c.have_m) {
+        return check_error::missing_m;
+    }
+    if (needs_m(c.op)
+        && (c.big ? c.big_b.is_negative() || c.big_m.is_negative() || c.big_m.is_zero() : c.b < 0 || c.m <= 0)) {
+        return check_error::powmod_domain;
+    }
+    return check_error::none;
+}
+
+bool sieve_range(const context& c, std::uint64_t* a, std::uint64_t* b)
+{
+    if (c.big) {
+        if (c.big_a.is_negative() || !c.big_a.to_u64(a) || !c.big_b.to_u64(b)) {
+            return false;
+        }
+    } else {
+        if (c.a < 0 || c.b < 0) {
+            return false;
+        }
+        *a = static_cast<std::uint64_t>(c.a);
+        *b = static_cast<std::uint64_t>(c.b);
+    }
+    return *a <= *b && *b <= kSieveMax;
+}
+
+const char* math_err_str(mathlib::ml_error e)
+{
+    if (e == mathlib::ml_error::div0) {
+        return "division by zero";
+    }
+    if (e == mathlib::ml_error::overflow) {
+        return "overflow";
+    }
+    return "math error";
+}
+
+// C(n, k) = C(n, k - 1) (n - k + 1) / k for k = 1, 2, ..., min(k, n - k).
+// Dividing out g = gcd(r, i) first leaves i / g coprime to r / g, so i / g
+// divides the next factor and every step is exact. The partial results grow
+// with i, so once one overflows the answer does too.
+mathlib::ml_result binom_i64(std::uint64_t n, std::uint64_t k)
+{
+    mathlib::ml_result res {};
+    res.kind = mathlib::ml_kind::i64;
+    res.error = mathlib::ml_error::ok;
+    if (k > n) {
+        return res;
+    }
+    k = std::min(k, n - k);
+    std::uint64_t r = 1;
+    for (std::uint64_t i = 1; i <= k; ++i) {
+        const std::uint64_t g = std::gcd(r, i);
+        const std::uint64_t f = (n - k + i) / (i / g);
+        if (__builtin_mul_overflow(r / g, f, &r) || r > static_cast<std::uint64_t>(INT64_MAX)) {
+            res.error = mathlib::ml_error::overflow;
+            return res;
+        }
+    }
+    res.value.i64 = static_cast<std::int64_t>(r);
+    return res;
+}
+
+exit_code calc(context& c)
+{
+    if (c.big) {
+        return calc_big(c);
+    }
+
+    switch (c.op) {
+    case operation::add: {
+        c.r = mathlib::ml_add(c.a, c.b);
+        break;
+    }
+    case operation::sub: {
+        c.r = mathlib::ml_sub(c.a, c.b);
+        break;
+    }
+    case operation::mul: {
+        c.r = mathlib::ml_mul(c.a, c.b);
+        break;
+    }
+    case operation::div: {
+        c.r = mathlib::ml_div(c.a, c.b);
+        break;
+    }
+    case operation::mod:
+    case operation::divmod: {
+        // Truncating like div, so the remainder takes the sign of a. The
+        // quotient INT64_MIN / -1 overflows, but its remainder is 0.
+        c.r = mathlib::ml_div(c.a, c.b);
+        if (c.r.error == mathlib::ml_error::div0) {
+            break;
+        }
+        mathlib::ml_result rem {};
+        rem.kind = mathlib::ml_kind::i64;
+        rem.error = mathlib::ml_error::ok;
+        rem.value.i64 = c.b == -1 ? 0 : c.a % c.b;
+        if (c.op == operation::mod) {
+            c.r = rem;
+        } else {
+            c.r2 = rem;
+        }
+        break;
+    }
+    case operation::pow: {
+        c.r = mathlib::ml_pow(c.a, static_cast<std::uint64_t>(c.b));
+        break;
+    }
+    case operation::powmod: {
+        // a mod m in [0, m) first; the result is below m, so it fits in i64.
+        const auto m = static_cast<std::uint64_t>(c.m);
+        const std::int64_t rem = c.a % c.m;
+        const std::uint64_t x = rem < 0 ? static_cast<std::uint64_t>(rem + c.m) : static_cast<std::uint64_t>(rem);
+        c.r.kind = mathlib::ml_kind::i64;
+        c.r.error = mathlib::ml_error::ok;
+        c.r.value.i64 = static_cast<std::int64_t>(powmod_u64(x, static_cast<std::uint64_t>(c.b), m));
+        break;
+    }
+    case operation::isprime: {
+        c.r.kind = mathlib::ml_kind::i64;
+        c.r.error = mathlib::ml_error::ok;
+        c.r.value.i64 = c.a >= 0 && is_prime_u64(static_cast<std::uint64_t>(c.a)) ? 1 : 0;
+        break;
+    }
+    case operation::factor: {
+        c.r.kind = mathlib::ml_kind::i64;
+        c.r.error = mathlib::ml_error::ok;
+        c.factors = factor_u64(static_cast<std::uint64_t>(c.a));
+        break;
+    }
+    case operation::primecount: {
+        c.r.kind = mathlib::ml_kind::i64;
+        c.r.error = mathlib::ml_error::ok;
+        c.r.value.i64 = static_cast<std::int64_t>(
+            count_primes(static_cast<std::uint64_t>(c.a), static_cast<std::uint64_t>(c.b), c.threads));
+        break;
+    }
+    case operation::binom: {
+        c.r = binom_i64(static_cast<std::uint64_t>(c.a), static_cast<std::uint64_t>(c.b));
+        break;
+    }
+    case operation::fact: {
+        c.r = mathlib::ml_fact(static_cast<std::uint64_t>(c.a));
+        break;
+    }
+    case operation::none:
+    default: {
+        std::fprintf(stderr, "Error: unknown operation\n");
+        return exit_code::usage;
+    }
+    }
+    return exit_code::ok;
+}
@@ -0,0 +1,351 @@
+#include <columnar.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CALC_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Lanes per output block; a multiple of 64 so blocks fill whole bitmap words.
+constexpr size_t kBlockLanes = size_t { 1 } << 16;
+
+using kernel_fn = void (*)(const std::int64_t*, const std::int64_t*, std::int64_t*, std::uint64_t*, size_t);
+
+mathlib::ml_result scalar_op(operation op, std::int64_t a, std::int64_t b)
+{
+    if (op == operation::add) {
+        return mathlib::ml_add(a, b);
+    }
+    if (op == operation::sub) {
+        return mathlib::ml_sub(a, b);
+    }
+    return mathlib::ml_mul(a, b);
+}
+
+// Evaluates lane i with mathlib and records the outcome in out/overflow.
+void scalar_lane(operation op, const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t i)
+{
+    const mathlib::ml_result r = scalar_op(op, a[i], b[i]);
+    const std::uint64_t bit = std::uint64_t { 1 } << (i % 64);
+    if (r.error != mathlib::ml_error::ok) {
+        out[i] = 0;
+        overflow[i / 64] |= bit;
+    } else {
+        out[i] = r.value.i64;
+        overflow[i / 64] &= ~bit;
+    }
+}
+
+template <operation Op>
+void scalar_kernel(const std::int64_t* a, const std::int64_t* b, std::int64_t* out, std::uint64_t* overflow, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        scalar_lane(Op, a, b, out, overflow, i);
+    }
+}
+
+#ifdef CALC_X86_KERNELS
+
+// Kernels handle whole 64-lane groups and leave the tail to scalar_kernel.
+
+__attribute__((target("avx2"))) __m256i avx2_overflow_mask(__m256i sign_bits)
+{
+    return _mm256_cmpgt_epi64(_mm256_setzero_si256(), sign_bits);
+}
+
+template <operation Op>
+__attribute__((target("avx2"))) void avx2_addsub(const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t n)
+{
+    const size_t groups = n / 64;
+    for (size_t g = 0; g < groups; ++g) {
+        std::uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 4) {
+            const size_t i = g * 64 + j;
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            __m256i r;
+            __m256i sign;
+            if (Op == operation::add) {
+                // Overflow iff both operands have the same sign and the sum's differs.
+                r = _mm256_add_epi64(va, vb);
+                sign = _mm256_andnot_si256(_mm256_xor_si256(va, vb), _mm256_xor_si256(va, r));
+            } else {
+                // Overflow iff the operands' signs differ and the result's differs from a.
+                r = _mm256_sub_epi64(va, vb);
+                sign = _mm256_and_si256(_mm256_xor_si256(va, vb), _mm256_xor_si256(va, r));
+            }
+            const __m256i mask = avx2_overflow_mask(sign);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_andnot_si256(mask, r));
+            word |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(mask))) << j;
+        }
+        overflow[g] = word;
+    }
+}
+
+// There is no 64x64 multiply with a high half in AVX2, so lanes where both
+// operands fit in int32 (whose product cannot overflow) use vpmuldq and the
+// rest fall back to mathlib.
+__attribute__((target("avx2"))) void avx2_mul(const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t n)
+{
+    const __m256i bias = _mm256_set1_epi64x(0x80000000LL);
+    const __m256i zero = _mm256_setzero_si256();
+    const size_t groups = n / 64;
+    for (size_t g = 0; g < groups; ++g) {
+        std::uint64_t wide = 0;
+        for (size_t j = 0; j < 64; j += 4) {
+            const size_t i = g * 64 + j;
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            const __m256i hi = _mm256_or_si256(_mm256_srli_epi64(_mm256_add_epi64(va, bias), 32),
+                _mm256_srli_epi64(_mm256_add_epi64(vb, bias), 32));
+            const __m256i narrow = _mm256_cmpeq_epi64(hi, zero);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_mul_epi32(va, vb));
+            wide |= static_cast<std::uint64_t>(~_mm256_movemask_pd(_mm256_castsi256_pd(narrow)) & 0xf) << j;
+        }
+        overflow[g] = 0;
+        while (wide != 0) {
+            const auto j = static_cast<size_t>(__builtin_ctzll(wide));
+            scalar_lane(operation::mul, a, b, out, overflow, g * 64 + j);
+            wide &= wide - 1;
+        }
+    }
+}
+
+template <operation Op>
+__attribute__((target("avx512f"))) void avx512_addsub(const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t n)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const size_t groups = n / 64;
+    for (size_t g = 0; g < groups; ++g) {
+        std::uint64_t word = 0;
+        for (size_t j = 0; j < 64; j += 8) {
+            const size_t i = g * 64 + j;
+            const __m512i va = _mm512_loadu_si512(a + i);
+            const __m512i vb = _mm512_loadu_si512(b + i);
+            __m512i r;
+            __m512i sign;
+            if (Op == operation::add) {
+                r = _mm512_add_epi64(va, vb);
+                sign = _mm512_andnot_si512(_mm512_xor_si512(va, vb), _mm512_xor_si512(va, r));
+            } else {
+                r = _mm512_sub_epi64(va, vb);
+                sign = _mm512_and_si512(_mm512_xor_si512(va, vb), _mm512_xor_si512(va, r));
+            }
+            const __mmask8 mask = _mm512_cmplt_epi64_mask(sign, zero);
+            _mm512_storeu_si512(out + i, _mm512_maskz_mov_epi64(static_cast<__mmask8>(~mask), r));
+            word |= static_cast<std::uint64_t>(mask) << j;
+        }
+        overflow[g] = word;
+    }
+}
+
+__attribute__((target("avx512f"))) void avx512_mul(const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t n)
+{
+    const size_t groups = n / 64;
+    for (size_t g = 0; g < groups; ++g) {
+        std::uint64_t wide = 0;
+        for (size_t j = 0; j < 64; j += 8) {
+            const size_t i = g * 64 + j;
+            const __m512i va = _mm512_loadu_si512(a + i);
+            const __m512i vb = _mm512_loadu_si512(b + i);
+            const __mmask8 narrow_a = _mm512_cmpeq_epi64_mask(_mm512_srai_epi64(_mm512_slli_epi64(va, 32), 32), va);
+            const __mmask8 narrow_b = _mm512_cmpeq_epi64_mask(_mm512_srai_epi64(_mm512_slli_epi64(vb, 32), 32), vb);
+            _mm512_storeu_si512(out + i, _mm512_mul_epi32(va, vb));
+            wide |= static_cast<std::uint64_t>(static_cast<__mmask8>(~(narrow_a & narrow_b))) << j;
+        }
+        overflow[g] = 0;
+        while (wide != 0) {
+            const auto j = static_cast<size_t>(__builtin_ctzll(wide));
+            scalar_lane(operation::mul, a, b, out, overflow, g * 64 + j);
+            wide &= wide - 1;
+        }
+    }
+}
+
+#endif
+
+enum class isa : std::uint8_t {
+    scalar,
+    avx2,
+    avx512
+};
+
+isa detect()
+{
+#ifdef CALC_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return isa::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return isa::avx2;
+    }
+#endif
+    return isa::scalar;
+}
+
+isa host_isa()
+{
+    static const isa kIsa = detect();
+    return kIsa;
+}
+
+kernel_fn pick(operation op)
+{
+#ifdef CALC_X86_KERNELS
+    const isa level = host_isa();
+    if (level == isa::avx512) {
+        return op == operation::add ? avx512_addsub<operation::add>
+            : op == operation::sub  ? avx512_addsub<operation::sub>
+                                    : avx512_mul;
+    }
+    if (level == isa::avx2) {
+        return op == operation::add ? avx2_addsub<operation::add>
+            : op == operation::sub  ? avx2_addsub<operation::sub>
+                                    : avx2_mul;
+    }
+#endif
+    (void)op;
+    return nullptr;
+}
+
+// a mod m in [0, m) for m > 0.
+std::uint64_t residue(std::int64_t a, std::int64_t m)
+{
+    const std::int64_t r = a % m;
+    return static_cast<std::uint64_t>(r < 0 ? r + m : r);
+}
+
+} // namespace
+
+bool columnar_supported(operation op)
+{
+    return op == operation::add || op == operation::sub || op == operation::mul || op == operation::powmod;
+}
+
+size_t columnar_columns(operation op)
+{
+    return op == operation::powmod ? 3 : 2;
+}
+
+const char* columnar_isa()
+{
+    switch (host_isa()) {
+    case isa::avx512:
+        return "avx512";
+    case isa::avx2:
+        return "avx2";
+    case isa::scalar:
+    default:
+        return "scalar";
+    }
+}
+
+void columnar_eval(operation op, const std::int64_t* a, const std::int64_t* b, std::int64_t* out,
+    std::uint64_t* overflow, size_t n)
+{
+    size_t done = 0;
+    if (kernel_fn kernel = pick(op)) {
+        done = n / 64 * 64;
+        kernel(a, b, out, overflow, done);
+    }
+    for (size_t i = done; i < n; ++i) {
+        scalar_lane(op, a, b, out, overflow, i);
+    }
+}
+
+void columnar_powmod(const std::int64_t* a, const std::int64_t* b, const std::int64_t* m, std::int64_t* out,
+    std::uint64_t* error, size_t n, modulus_cache& cache)
+{
+    std::fill(error, error + (n + 63) / 64, 0);
+    std::vector<std::pair<std::uint64_t, size_t>> order;
+    order.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (b[i] < 0 || m[i] <= 0) {
+            out[i] = 0;
+            error[i / 64] |= std::uint64_t { 1 } << (i % 64);
+        } else {
+            order.emplace_back(static_cast<std::uint64_t>(m[i]), i);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    for (size_t g = 0; g < order.size();) {
+        const std::uint64_t mod = order[g].first;
+        size_t end = g + 1;
+        while (end < order.size() && order[end].first == mod) {
+            ++end;
+        }
+        if ((mod & 1) != 0) {
+            const montgomery64& mont = cache.montgomery(mod);
+            for (size_t k = g; k < end; ++k) {
+                const size_t i = order[k].second;
+                const std::uint64_t x = mont.to(residue(a[i], m[i]));
+                out[i] = static_cast<std::int64_t>(mont.from(mont.pow(x, static_cast<std::uint64_t>(b[i]))));
+            }
+        } else {
+            const barrett64& bar = cache.barrett(mod);
+            for (size_t k = g; k < end; ++k) {
+                const size_t i = order[k].second;
+                out[i] = static_cast<std::int64_t>(bar.pow(residue(a[i], m[i]), static_cast<std::uint64_t>(b[i])));
+            }
+        }
+        g = end;
+    }
+}
+
+exit_code run_columnar(operation op, const char* data, size_t size, out_buffer& out)
+{
+    const size_t columns = columnar_columns(op);
+    if (size % (8 * columns) != 0) {
+        std::fprintf(stderr, "Error: columnar: input is not %zu equal int64 columns (%zu bytes)\n", columns, size);
+        return exit_code::usage;
+    }
+
+    const size_t n = size / (8 * columns);
+    std::vector<std::int64_t> a(std::min(n, kBlockLanes));
+    std::vector<std::int64_t> b(a.size());
+    std::vector<std::int64_t> m(columns == 3 ? a.size() : 0);
+    std::vector<std::int64_t> r(a.size());
+    std::vector<std::uint64_t> overflow((n + 63) / 64);
+    modulus_cache cache;
+
+    for (size_t done = 0; done < n;) {
+        const size_t lanes = std::min(kBlockLanes, n - done);
+        // Copy into typed blocks: the input is raw bytes with no alignment
+        // guarantee, and the block stays cache-resident for the kernel.
+        std::memcpy(a.data(), data + done * 8, lanes * 8);
+        std::memcpy(b.data(), data + (n + done) * 8, lanes * 8);
+        if (op == operation::powmod) {
+            std::memcpy(m.data(), data + (2 * n + done) * 8, lanes * 8);
+            columnar_powmod(a.data(), b.data(), m.data(), r.data(), overflow.data() + done / 64, lanes, cache);
+        } else {
+            columnar_eval(op, a.data(), b.data(), r.data(), overflow.data() + done / 64, lanes);
+        }
+        out.write(r.data(), lanes * sizeof(std::int64_t));
+        if (!out.good()) {
+            std::fprintf(stderr, "Error: columnar: I/O error\n");
+            return exit_code::usage;
+        }
+        done += lanes;
+    }
+
+    out.write(overflow.data(), overflow.size() * sizeof(std::uint64_t));
+    if (!out.flush()) {
+        std::fprintf(stderr, "Error: columnar: I/O error\n");
+        return exit_code::usage;
+    }
+    return exit_code::ok;
+}
@@ -0,0 +1,562 @@
+#include <expr.h>
+
+#include <calc.h>
+#include <mathlib.h>
+#include <modarith.h>
+
+#include <cstring>
+
+namespace {
+
+constexpr std::uint64_t kI64MinMagnitude = std::uint64_t { 1 } << 63;
+constexpr int kMaxDepth = 256;
+constexpr std::uint32_t kNoNode = UINT32_MAX;
+
+// Binding powers: an infix operator takes the operand on its left when its
+// left power is at least the caller's minimum, and parses its right operand
+// with its right power. lbp < rbp makes an operator left-associative.
+constexpr int kPrefixBp = 25;
+constexpr int kPostfixBp = 40;
+
+struct infix_spec {
+    char ch;
+    int lbp;
+    int rbp;
+    expr_kind kind;
+};
+
+constexpr infix_spec kInfix[] = {
+    { '+', 10, 11, expr_kind::add },
+    { '-', 10, 11, expr_kind::sub },
+    { '*', 20, 21, expr_kind::mul },
+    { '/', 20, 21, expr_kind::div },
+    { '%', 20, 21, expr_kind::mod },
+    { '^', 31, 30, expr_kind::pow },
+};
+
+struct function_spec {
+    const char* name;
+    expr_kind kind;
+};
+
+constexpr function_spec kFunctions[] = {
+    { "pow", expr_kind::pow },
+    { "fact", expr_kind::fact },
+    { "binom", expr_kind::binom },
+    { "powmod", expr_kind::powmod },
+};
+
+enum class token_kind : std::uint8_t {
+    end,
+    number,
+    name,
+    punct
+};
+
+struct token {
+    token_kind kind = token_kind::end;
+    char ch = 0; // punct only
+    std::uint32_t pos = 0;
+    std::uint32_t len = 0;
+};
+
+bool is_space(char ch)
+{
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+bool is_digit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+bool is_name_start(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+bool is_name_char(char ch)
+{
+    return is_name_start(ch) || is_digit(ch);
+}
+
+bool is_punct(char ch)
+{
+    return std::strchr("+-*/%^!(),", ch) != nullptr && ch != '\0';
+}
+
+class parser {
+public:
+    parser(const char* s, size_t n, const std::vector<std::string>& vars, expr_tree* out, expr_parse_error* err)
+        : s_(s)
+        , n_(n)
+        , vars_(vars)
+        , out_(out)
+        , err_(err)
+    {
+    }
+
+    bool run()
+    {
+        if (n_ > UINT32_MAX) {
+            return fail(0, "expression too long");
+        }
+        out_->nodes.clear();
+        if (!lex()) {
+            return false;
+        }
+        std::uint32_t root = 0;
+        if (!expression(0, 0, &root)) {
+            return false;
+        }
+        if (tok_.kind != token_kind::end) {
+            return tok_.ch == ')' ? fail(tok_.pos, "unmatched ')'") : fail(tok_.pos, "expected an operator");
+        }
+        out_->root = root;
+        return true;
+    }
+
+private:
+    bool fail(std::uint32_t pos, std::string message)
+    {
+        err_->message = std::move(message);
+        err_->pos = pos;
+        return false;
+    }
+
+    bool is(char ch) const { return tok_.kind == token_kind::punct && tok_.ch == ch; }
+
+    std::string text(const token& t) const { return std::string(s_ + t.pos, t.len); }
+
+    // Reads the token at p_ into tok_.
+    bool lex()
+    {
+        while (p_ < n_ && is_space(s_[p_])) {
+            ++p_;
+        }
+        tok_ = token {};
+        tok_.pos = static_cast<std::uint32_t>(p_);
+        if (p_ == n_) {
+            return true;
+        }
+        const char ch = s_[p_];
+        size_t end = p_ + 1;
+        if (is_digit(ch)) {
+            tok_.kind = token_kind::number;
+            while (end < n_ && is_digit(s_[end])) {
+                ++end;
+            }
+            if (end < n_ && is_name_char(s_[end])) {
+                return fail(static_cast<std::uint32_t>(end), "invalid digit in number");
+            }
+        } else if (is_name_start(ch)) {
+            tok_.kind = token_kind::name;
+            while (end < n_ && is_name_char(s_[end])) {
+                ++end;
+            }
+        } else if (is_punct(ch)) {
+            tok_.kind = token_kind::punct;
+            tok_.ch = ch;
+        } else {
+            return fail(tok_.pos, std::string("unexpected character '") + ch + "'");
+        }
+        tok_.len = static_cast<std::uint32_t>(end - p_);
+        p_ = end;
+        return true;
+    }
+
+    bool expect(char ch, const char* what)
+    {
+        if (!is(ch)) {
+            return fail(tok_.pos, std::string("expected '") + ch + "' " + what);
+        }
+        return lex();
+    }
+
+    std::uint32_t add(expr_kind kind, std::uint32_t pos, std::uint32_t a = 0, std::uint32_t b = 0, std::uint32_t c = 0)
+    {
+        expr_node nd;
+        nd.kind = kind;
+        nd.pos = pos;
+        nd.args[0] = a;
+        nd.args[1] = b;
+        nd.args[2] = c;
+        out_->nodes.push_back(nd);
+        return static_cast<std::uint32_t>(out_->nodes.size() - 1);
+    }
+
+    // Decimal digits. 2^63 is only accepted right after a unary minus that
+    // negates it alone, which then turns it into INT64_MIN.
+    bool number(bool after_minus, std::uint32_t* out)
+    {
+        const token t = tok_;
+        std::uint64_t v = 0;
+        for (std::uint32_t i = 0; i < t.len; ++i) {
+            const auto d = static_cast<std::uint64_t>(s_[t.pos + i] - '0');
+            if (v > (kI64MinMagnitude - d) / 10) {
+                return fail(t.pos, "integer literal out of range");
+            }
+            v = v * 10 + d;
+        }
+        if (!lex()) {
+            return false;
+        }
+        if (v == kI64MinMagnitude && (!after_minus || is('^') || is('!'))) {
+            return fail(t.pos, "integer literal out of range");
+        }
+        *out = add(expr_kind::literal, t.pos);
+        out_->nodes[*out].value = static_cast<std::int64_t>(v);
+        if (v == kI64MinMagnitude) {
+            min_literal_ = *out;
+        }
+        return true;
+    }
+
+    static std::string arity_message(const function_spec* fn)
+    {
+        const size_t arity = expr_arity(fn->kind);
+        return std::string(fn->name) + " takes " + std::to_string(arity) + (arity == 1 ? " argument" : " arguments");
+    }
+
+    bool call(const token& name, std::uint32_t depth, std::uint32_t* out)
+    {
+        const function_spec* fn = nullptr;
+        for (const function_spec& f : kFunctions) {
+            if (std::strlen(f.name) == name.len && std::memcmp(f.name, s_ + name.pos, name.len) == 0) {
+                fn = &f;
+            }
+        }
+        if (!fn) {
+            return fail(name.pos, "unknown function '" + text(name) + "'");
+        }
+        if (!lex()) {
+            return false;
+        }
+        const size_t arity = expr_arity(fn->kind);
+        std::uint32_t args[3] = {};
+        for (size_t i = 0; i < arity; ++i) {
+            if (i != 0 && is(')')) {
+                return fail(tok_.pos, arity_message(fn));
+            }
+            if (i != 0 && !expect(',', "between arguments")) {
+                return false;
+            }
+            if (!expression(0, depth + 1, &args[i])) {
+                return false;
+            }
+        }
+        if (is(',')) {
+            return fail(tok_.pos, arity_message(fn));
+        }
+        if (!expect(')', "to close the argument list")) {
+            return false;
+        }
+        *out = add(fn->kind, name.pos, args[0], args[1], args[2]);
+        return true;
+    }
+
+    bool operand(std::uint32_t depth, std::uint32_t* out)
+    {
+        const bool after_minus = after_minus_;
+        after_minus_ = false;
+        const token t = tok_;
+        switch (t.kind) {
+        case token_kind::number: {
+            return number(after_minus, out);
+        }
+        case token_kind::name: {
+            if (!lex()) {
+                return false;
+            }
+            if (is('(')) {
+                return call(t, depth, out);
+            }
+            for (size_t i = 0; i < vars_.size(); ++i) {
+                if (vars_[i].size() == t.len && std::memcmp(vars_[i].data(), s_ + t.pos, t.len) == 0) {
+                    *out = add(expr_kind::variable, t.pos);
+                    out_->nodes[*out].value = static_cast<std::int64_t>(i);
+                    return true;
+                }
+            }
+            for (const function_spec& f : kFunctions) {
+                if (text(t) == f.name) {
+                    return fail(tok_.pos, std::string("expected '(' after ") + f.name);
+                }
+            }
+            return fail(t.pos, "unknown variable '" + text(t) + "'");
+        }
+        case token_kind::punct: {
+            if (t.ch == '(') {
+                return lex() && expression(0, depth + 1, out) && expect(')', "to close '('");
+            }
+            if (t.ch == '+' || t.ch == '-') {
+                std::uint32_t a = 0;
+                if (!lex()) {
+                    return false;
+                }
+                after_minus_ = t.ch == '-';
+                if (!expression(kPrefixBp, depth + 1, &a)) {
+                    return false;
+                }
+                expr_node& nd = out_->nodes[a];
+                if (t.ch == '+') {
+                    *out = a;
+                } else if (a == min_literal_) {
+                    // The magnitude 2^63 already reads as INT64_MIN.
+                    nd.pos = t.pos;
+                    min_literal_ = kNoNode;
+                    *out = a;
+                } else if (nd.kind == expr_kind::literal && nd.value != INT64_MIN) {
+                    nd.value = -nd.value;
+                    nd.pos = t.pos;
+                    *out = a;
+                } else {
+                    *out = add(expr_kind::neg, t.pos, a);
+                }
+                return true;
+            }
+            return fail(t.pos, "expected an operand");
+        }
+        case token_kind::end:
+        default: {
+            return fail(t.pos, "unexpected end of expression");
+        }
+        }
+    }
+
+    bool expression(int min_bp, std::uint32_t depth, std::uint32_t* out)
+    {
+        if (depth > kMaxDepth) {
+            return fail(tok_.pos, "expression nested too deeply");
+        }
+        std::uint32_t lhs = 0;
+        if (!operand(depth, &lhs)) {
+            return false;
+        }
+        while (tok_.kind == token_kind::punct) {
+            const token op = tok_;
+            if (op.ch == '!') {
+                if (kPostfixBp < min_bp) {
+                    break;
+                }
+                lhs = add(expr_kind::fact, op.pos, lhs);
+                if (!lex()) {
+                    return false;
+                }
+                continue;
+            }
+            const infix_spec* spec = nullptr;
+            for (const infix_spec& s : kInfix) {
+                if (s.ch == op.ch) {
+                    spec = &s;
+                }
+            }
+            if (!spec || spec->lbp < min_bp) {
+                break;
+            }
+            std::uint32_t rhs = 0;
+            if (!lex() || !expression(spec->rbp, depth + 1, &rhs)) {
+                return false;
+            }
+            lhs = add(spec->kind, op.pos, lhs, rhs);
+        }
+        *out = lhs;
+        return true;
+    }
+
+    const char* s_;
+    size_t n_;
+    size_t p_ = 0;
+    token tok_;
+    bool after_minus_ = false;
+    std::uint32_t min_literal_ = kNoNode;
+    const std::vector<std::string>& vars_;
+    expr_tree* out_;
+    expr_parse_error* err_;
+};
+
+eval_error from_ml(const mathlib::ml_result& r, std::int64_t* out)
+{
+    if (r.error == mathlib::ml_error::div0) {
+        return eval_error::div0;
+    }
+    if (r.error != mathlib::ml_error::ok) {
+        return eval_error::overflow;
+    }
+    if (r.kind == mathlib::ml_kind::u64) {
+        if (r.value.u64 > static_cast<std::uint64_t>(INT64_MAX)) {
+            return eval_error::overflow;
+        }
+        *out = static_cast<std::int64_t>(r.value.u64);
+        return eval_error::none;
+    }
+    *out = r.value.i64;
+    return eval_error::none;
+}
+
+} // namespace
+
+size_t expr_arity(expr_kind k)
+{
+    switch (k) {
+    case expr_kind::literal:
+    case expr_kind::variable:
+    case expr_kind::fail: {
+        return 0;
+    }
+    case expr_kind::neg:
+    case expr_kind::fact: {
+        return 1;
+    }
+    case expr_kind::powmod: {
+        return 3;
+    }
+    default: {
+        return 2;
+    }
+    }
+}
+
+bool is_expr_name(const char* s, size_t n)
+{
+    if (n == 0 || !is_name_start(s[0])) {
+        return false;
+    }
+    for (size_t i = 1; i < n; ++i) {
+        if (!is_name_char(s[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parse_expr(const char* s, size_t n, const std::vector<std::string>& vars, expr_tree* out, expr_parse_error* err)
+{
+    return parser(s, n, vars, out, err).run();
+}
+
+eval_error apply_expr_op(expr_kind k, std::int64_t a, std::int64_t b, std::int64_t c, std::int64_t* out)
+{
+    switch (k) {
+    case expr_kind::neg: {
+        return from_ml(mathlib::ml_sub(0, a), out);
+    }
+    case expr_kind::add: {
+        return from_ml(mathlib::ml_add(a, b), out);
+    }
+    case expr_kind::sub: {
+        return from_ml(mathlib::ml_sub(a, b), out);
+    }
+    case expr_kind::mul: {
+        return from_ml(mathlib::ml_mul(a, b), out);
+    }
+    case expr_kind::div: {
+        return from_ml(mathlib::ml_div(a, b), out);
+    }
+    case expr_kind::mod: {
+        // As the mod operation: truncating, so the sign is that of a.
+        if (b == 0) {
+            return eval_error::div0;
+        }
+        *out = b == -1 ? 0 : a % b;
+        return eval_error::none;
+    }
+    case expr_kind::pow: {
+        if (b < 0) {
+            return eval_error::domain;
+        }
+        return from_ml(mathlib::ml_pow(a, static_cast<std::uint64_t>(b)), out);
+    }
+    case expr_kind::fact: {
+        if (a < 0) {
+            return eval_error::domain;
+        }
+        return from_ml(mathlib::ml_fact(static_cast<std::uint64_t>(a)), out);
+    }
+    case expr_kind::binom: {
+        if (a < 0 || b < 0) {
+            return eval_error::domain;
+        }
+        return from_ml(binom_i64(static_cast<std::uint64_t>(a), static_cast<std::uint64_t>(b)), out);
+    }
+    case expr_kind::powmod: {
+        if (b < 0 || c <= 0) {
+            return eval_error::domain;
+        }
+        const std::int64_t rem = a % c;
+        const std::uint64_t x = rem < 0 ? static_cast<std::uint64_t>(rem + c) : static_cast<std::uint64_t>(rem);
+        *out = static_cast<std::int64_t>(powmod_u64(x, static_cast<std::uint64_t>(b), static_cast<std::uint64_t>(c)));
+        return eval_error::none;
+    }
+    case expr_kind::shl: {
+        // a * 2^b overflows exactly when shifting back loses bits.
+        const auto v = static_cast<std::int64_t>(static_cast<std::uint64_t>(a) << b);
+        if ((v >> b) != a) {
+            return eval_error::overflow;
+        }
+        *out = v;
+        return eval_error::none;
+    }
+    case expr_kind::div_pow2: {
+        *out = shift_div(a, b);
+        return eval_error::none;
+    }
+    case expr_kind::mod_pow2: {
+        *out = a - static_cast<std::int64_t>(static_cast<std::uint64_t>(shift_div(a, b)) << b);
+        return eval_error::none;
+    }
+    case expr_kind::literal:
+    case expr_kind::variable:
+    case expr_kind::fail:
+    default: {
+        return eval_error::domain;
+    }
+    }
+}
+
+eval_result eval_expr(const expr_tree& t, const std::int64_t* vars)
+{
+    // Operands precede their users, so one pass in array order evaluates
+    // every node after its operands.
+    std::vector<std::int64_t> v(t.nodes.size());
+    eval_result res;
+    for (size_t i = 0; i < t.nodes.size(); ++i) {
+        const expr_node& nd = t.nodes[i];
+        if (nd.kind == expr_kind::literal) {
+            v[i] = nd.value;
+        } else if (nd.kind == expr_kind::variable) {
+            v[i] = vars[nd.value];
+        } else if (nd.kind == expr_kind::fail) {
+            res.error = static_cast<eval_error>(nd.value);
+            res.pos = nd.pos;
+            return res;
+        } else {
+            res.error = apply_expr_op(nd.kind, v[nd.args[0]], v[nd.args[1]], v[nd.args[2]], &v[i]);
+            if (res.error != eval_error::none) {
+                res.pos = nd.pos;
+                return res;
+            }
+        }
+    }
+    res.value = v[t.root];
+    return res;
+}
+
+const char* eval_err_str(eval_error e)
+{
+    switch (e) {
+    case eval_error::div0: {
+        return "division by zero";
+    }
+    case eval_error::overflow: {
+        return "overflow";
+    }
+    case eval_error::domain: {
+        return "domain error";
+    }
+    case eval_error::none:
+    default: {
+        return "ok";
+    }
+    }
+}
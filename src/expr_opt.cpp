@@ -0,0 +1,228 @@
+#include <expr_opt.h>
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace {
+
+// k when v = 2^k with 1 <= k <= 62, else 0.
+std::int64_t pow2_exponent(std::int64_t v)
+{
+    if (v < 2 || (v & (v - 1)) != 0) {
+        return 0;
+    }
+    return __builtin_ctzll(static_cast<unsigned long long>(v));
+}
+
+class optimizer {
+public:
+    explicit optimizer(expr_tree* out)
+        : out_(out)
+    {
+        out_->nodes.clear();
+    }
+
+    // nd with its operands already mapped to the output tree; returns the
+    // output node that computes it.
+    std::uint32_t rewrite(expr_node nd)
+    {
+        const size_t arity = expr_arity(nd.kind);
+        std::int64_t lit[3] = {};
+        size_t constant = 0;
+        for (size_t j = 0; j < arity; ++j) {
+            constant += literal_value(nd.args[j], &lit[j]) ? 1 : 0;
+        }
+        if (arity != 0 && constant == arity) {
+            return fold(nd, lit);
+        }
+
+        const std::uint32_t a = nd.args[0];
+        const std::uint32_t b = nd.args[1];
+        std::int64_t va = 0;
+        std::int64_t vb = 0;
+        const bool lit_a = arity > 0 && literal_value(a, &va);
+        const bool lit_b = arity > 1 && literal_value(b, &vb);
+        switch (nd.kind) {
+        case expr_kind::add: {
+            if (lit_b && vb == 0) {
+                return a;
+            }
+            if (lit_a && va == 0) {
+                return b;
+            }
+            break;
+        }
+        case expr_kind::sub: {
+            if (lit_b && vb == 0) {
+                return a;
+            }
+            break;
+        }
+        case expr_kind::mul: {
+            if (lit_a) {
+                return rewrite_mul(nd, b, va);
+            }
+            if (lit_b) {
+                return rewrite_mul(nd, a, vb);
+            }
+            break;
+        }
+        case expr_kind::div:
+        case expr_kind::mod: {
+            if (!lit_b) {
+                break;
+            }
+            if (vb == 1 && nd.kind == expr_kind::div) {
+                return a;
+            }
+            if (const std::int64_t k = pow2_exponent(vb)) {
+                nd.kind = nd.kind == expr_kind::div ? expr_kind::div_pow2 : expr_kind::mod_pow2;
+                nd.args[1] = literal(k, out_->nodes[b].pos);
+            }
+            break;
+        }
+        case expr_kind::pow: {
+            if (lit_b && vb == 1) {
+                return a;
+            }
+            if (lit_b && vb == 2) {
+                nd.kind = expr_kind::mul;
+                nd.args[1] = a;
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+        }
+        return intern(nd);
+    }
+
+    void finish(std::uint32_t root)
+    {
+        // Folding and merging leave constant operands and duplicates behind;
+        // keep what the root still reaches, in the same order.
+        std::vector<expr_node>& nodes = out_->nodes;
+        std::vector<bool> live(nodes.size());
+        live[root] = true;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            if (live[i]) {
+                for (size_t j = 0; j < expr_arity(nodes[i].kind); ++j) {
+                    live[nodes[i].args[j]] = true;
+                }
+            }
+        }
+        std::vector<std::uint32_t> index(nodes.size());
+        size_t kept = 0;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!live[i]) {
+                continue;
+            }
+            expr_node nd = nodes[i];
+            for (size_t j = 0; j < expr_arity(nd.kind); ++j) {
+                nd.args[j] = index[nd.args[j]];
+            }
+            index[i] = static_cast<std::uint32_t>(kept);
+            nodes[kept++] = nd;
+        }
+        nodes.resize(kept);
+        out_->root = index[root];
+    }
+
+private:
+    using key = std::tuple<expr_kind, std::uint32_t, std::uint32_t, std::uint32_t, std::int64_t>;
+
+    bool literal_value(std::uint32_t i, std::int64_t* v) const
+    {
+        const expr_node& nd = out_->nodes[i];
+        if (nd.kind != expr_kind::literal) {
+            return false;
+        }
+        *v = nd.value;
+        return true;
+    }
+
+    // The first node equal to nd, appended if there is none. It comes no
+    // later in the evaluation order, so any error it raises is raised no
+    // later either.
+    std::uint32_t intern(expr_node nd)
+    {
+        const size_t arity = expr_arity(nd.kind);
+        for (size_t j = arity; j < 3; ++j) {
+            nd.args[j] = 0;
+        }
+        if (nd.kind == expr_kind::add || nd.kind == expr_kind::mul) {
+            if (nd.args[0] > nd.args[1]) {
+                std::swap(nd.args[0], nd.args[1]);
+            }
+        }
+        const key k(nd.kind, nd.args[0], nd.args[1], nd.args[2], nd.value);
+        const auto it = interned_.find(k);
+        if (it != interned_.end()) {
+            return it->second;
+        }
+        out_->nodes.push_back(nd);
+        const auto i = static_cast<std::uint32_t>(out_->nodes.size() - 1);
+        interned_.emplace(k, i);
+        return i;
+    }
+
+    std::uint32_t literal(std::int64_t v, std::uint32_t pos)
+    {
+        expr_node nd;
+        nd.kind = expr_kind::literal;
+        nd.pos = pos;
+        nd.value = v;
+        return intern(nd);
+    }
+
+    std::uint32_t fold(const expr_node& nd, const std::int64_t* lit)
+    {
+        std::int64_t v = 0;
+        const eval_error e = apply_expr_op(nd.kind, lit[0], lit[1], lit[2], &v);
+        if (e == eval_error::none) {
+            return literal(v, nd.pos);
+        }
+        expr_node f;
+        f.kind = expr_kind::fail;
+        f.pos = nd.pos;
+        f.value = static_cast<std::int64_t>(e);
+        return intern(f);
+    }
+
+    // x * c: x * 1 is x and x * 2^k a checked shift.
+    std::uint32_t rewrite_mul(expr_node nd, std::uint32_t x, std::int64_t c)
+    {
+        if (c == 1) {
+            return x;
+        }
+        if (const std::int64_t k = pow2_exponent(c)) {
+            nd.kind = expr_kind::shl;
+            nd.args[0] = x;
+            nd.args[1] = literal(k, nd.pos);
+        }
+        return intern(nd);
+    }
+
+    expr_tree* out_;
+    std::map<key, std::uint32_t> interned_;
+};
+
+} // namespace
+
+void optimize_expr(const expr_tree& in, expr_tree* out)
+{
+    // Operands come first, so one forward pass sees every operand already
+    // rewritten.
+    optimizer opt(out);
+    std::vector<std::uint32_t> index(in.nodes.size());
+    for (size_t i = 0; i < in.nodes.size(); ++i) {
+        expr_node nd = in.nodes[i];
+        for (size_t j = 0; j < expr_arity(nd.kind); ++j) {
+            nd.args[j] = index[nd.args[j]];
+        }
+        index[i] = opt.rewrite(nd);
+    }
+    opt.finish(index[in.root]);
+}
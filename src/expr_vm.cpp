@@ -0,0 +1,468 @@
+#include <expr_vm.h>
+
+#include <batch.h>
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+// Computed goto (a GCC/Clang extension) jumps straight from one handler to
+// the next through a label table; otherwise the loop dispatches with a
+// switch. Set through the CALC_COMPUTED_GOTO CMake option.
+#ifndef CALC_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define CALC_COMPUTED_GOTO 1
+#else
+#define CALC_COMPUTED_GOTO 0
+#endif
+#endif
+
+namespace {
+
+expr_opcode opcode_for(expr_kind k)
+{
+    switch (k) {
+    case expr_kind::neg: {
+        return expr_opcode::neg;
+    }
+    case expr_kind::add: {
+        return expr_opcode::add;
+    }
+    case expr_kind::sub: {
+        return expr_opcode::sub;
+    }
+    case expr_kind::mul: {
+        return expr_opcode::mul;
+    }
+    case expr_kind::div: {
+        return expr_opcode::div;
+    }
+    case expr_kind::mod: {
+        return expr_opcode::mod;
+    }
+    case expr_kind::pow: {
+        return expr_opcode::pow;
+    }
+    case expr_kind::fact: {
+        return expr_opcode::fact;
+    }
+    case expr_kind::binom: {
+        return expr_opcode::binom;
+    }
+    case expr_kind::powmod: {
+        return expr_opcode::powmod;
+    }
+    case expr_kind::shl: {
+        return expr_opcode::shl;
+    }
+    case expr_kind::div_pow2: {
+        return expr_opcode::div_pow2;
+    }
+    case expr_kind::mod_pow2: {
+        return expr_opcode::mod_pow2;
+    }
+    case expr_kind::fail:
+    default: {
+        return expr_opcode::fail;
+    }
+    }
+}
+
+expr_kind kind_for(expr_opcode op)
+{
+    switch (op) {
+    case expr_opcode::pow: {
+        return expr_kind::pow;
+    }
+    case expr_opcode::fact: {
+        return expr_kind::fact;
+    }
+    case expr_opcode::binom: {
+        return expr_kind::binom;
+    }
+    case expr_opcode::powmod:
+    default: {
+        return expr_kind::powmod;
+    }
+    }
+}
+
+bool is_blank(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+std::uint64_t load_le64(const unsigned char* p)
+{
+    std::uint64_t v = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        v |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+wire_error to_wire(eval_error e)
+{
+    switch (e) {
+    case eval_error::none: {
+        return wire_error::ok;
+    }
+    case eval_error::div0: {
+        return wire_error::div0;
+    }
+    case eval_error::overflow: {
+        return wire_error::overflow;
+    }
+    case eval_error::domain:
+    default: {
+        return wire_error::domain;
+    }
+    }
+}
+
+void put_row_error(out_buffer& out, const char* what)
+{
+    out.write("error: ", 7);
+    out.write(what, std::strlen(what));
+    out.put('\n');
+}
+
+void eval_text_row(const expr_program& p, std::int64_t* regs, const char* line, const char* end, out_buffer& out)
+{
+    size_t n = 0;
+    while (line != end) {
+        while (line != end && is_blank(*line)) {
+            ++line;
+        }
+        if (line == end) {
+            break;
+        }
+        const char* start = line;
+        while (line != end && !is_blank(*line)) {
+            ++line;
+        }
+        if (n == p.vars) {
+            ++n;
+            break;
+        }
+        if (!parse_i64(start, static_cast<size_t>(line - start), &regs[n])) {
+            out.write("error: invalid integer '", 24);
+            out.write(start, static_cast<size_t>(line - start));
+            out.write("'\n", 2);
+            return;
+        }
+        ++n;
+    }
+    if (n != p.vars) {
+        char what[64];
+        std::snprintf(what, sizeof(what), "expected %zu values", p.vars);
+        put_row_error(out, what);
+        return;
+    }
+
+    const eval_result r = run_expr_program(p, regs);
+    if (r.error != eval_error::none) {
+        char what[64];
+        std::snprintf(what, sizeof(what), "%s at column %u", eval_err_str(r.error), r.pos + 1);
+        put_row_error(out, what);
+        return;
+    }
+    out.put_i64(r.value);
+    out.put('\n');
+}
+
+exit_code run_text_rows(const expr_program& p, const char* data, size_t size, out_buffer& out)
+{
+    std::vector<std::int64_t> regs = p.init;
+    const char* end = data + size;
+    for (const char* line = data; line != end && out.good();) {
+        const void* nl = std::memchr(line, '\n', static_cast<size_t>(end - line));
+        const char* eol = nl != nullptr ? static_cast<const char*>(nl) : end;
+        eval_text_row(p, regs.data(), line, eol, out);
+        line = eol == end ? end : eol + 1;
+    }
+    if (!out.flush()) {
+        std::fprintf(stderr, "Error: expr: I/O error\n");
+        return exit_code::usage;
+    }
+    return exit_code::ok;
+}
+
+exit_code run_binary_rows(const expr_program& p, const char* data, size_t size, out_buffer& out)
+{
+    const size_t record = 8 * p.vars;
+    if (size % record != 0) {
+        std::fprintf(stderr, "Error: expr: truncated record (%zu trailing bytes)\n", size % record);
+        return exit_code::usage;
+    }
+
+    std::vector<std::int64_t> regs = p.init;
+    const auto* in = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size / record && out.good(); ++i) {
+        for (size_t v = 0; v < p.vars; ++v) {
+            regs[v] = static_cast<std::int64_t>(load_le64(in + i * record + 8 * v));
+        }
+        const eval_result r = run_expr_program(p, regs.data());
+        out.put(static_cast<char>(wire_kind::i64));
+        out.put(static_cast<char>(to_wire(r.error)));
+        out.put_le64(r.error == eval_error::none ? static_cast<std::uint64_t>(r.value) : 0);
+    }
+    if (!out.flush()) {
+        std::fprintf(stderr, "Error: expr: I/O error\n");
+        return exit_code::usage;
+    }
+    return exit_code::ok;
+}
+
+} // namespace
+
+bool compile_expr(const expr_tree& t, size_t vars, expr_program* out)
+{
+    const std::vector<expr_node>& nodes = t.nodes;
+    *out = expr_program {};
+    out->vars = vars;
+    out->init.assign(vars, 0);
+
+    // Only nodes reachable from the root are compiled; uses counts how many
+    // of those read each node, so that a temporary is freed after its last
+    // reader.
+    std::vector<bool> live(nodes.size());
+    std::vector<std::uint32_t> uses(nodes.size());
+    live[t.root] = true;
+    ++uses[t.root];
+    for (size_t i = nodes.size(); i-- > 0;) {
+        if (!live[i]) {
+            continue;
+        }
+        for (size_t j = 0; j < expr_arity(nodes[i].kind); ++j) {
+            live[nodes[i].args[j]] = true;
+            ++uses[nodes[i].args[j]];
+        }
+    }
+
+    std::vector<size_t> reg(nodes.size());
+    std::unordered_map<std::int64_t, size_t> constants;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (!live[i]) {
+            continue;
+        }
+        if (nodes[i].kind == expr_kind::variable) {
+            reg[i] = static_cast<size_t>(nodes[i].value);
+        } else if (nodes[i].kind == expr_kind::literal) {
+            auto it = constants.find(nodes[i].value);
+            if (it == constants.end()) {
+                it = constants.emplace(nodes[i].value, out->init.size()).first;
+                out->init.push_back(nodes[i].value);
+            }
+            reg[i] = it->second;
+        }
+    }
+
+    const size_t temps = out->init.size();
+    std::vector<size_t> free_regs;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const expr_node& nd = nodes[i];
+        if (!live[i] || nd.kind == expr_kind::literal || nd.kind == expr_kind::variable) {
+            continue;
+        }
+        expr_instr in {};
+        in.op = opcode_for(nd.kind);
+        if (nd.kind == expr_kind::fail) {
+            in.a = static_cast<std::uint16_t>(nd.value);
+        }
+        std::uint16_t* operands[3] = { &in.a, &in.b, &in.c };
+        for (size_t j = 0; j < expr_arity(nd.kind); ++j) {
+            const std::uint32_t arg = nd.args[j];
+            *operands[j] = static_cast<std::uint16_t>(reg[arg]);
+            if (--uses[arg] == 0 && reg[arg] >= temps) {
+                free_regs.push_back(reg[arg]);
+            }
+        }
+        // Operands are read before dst is written, so dst may reuse one.
+        if (free_regs.empty()) {
+            free_regs.push_back(out->init.size());
+            out->init.push_back(0);
+        }
+        reg[i] = free_regs.back();
+        free_regs.pop_back();
+        in.dst = static_cast<std::uint16_t>(reg[i]);
+        out->code.push_back(in);
+        out->pos.push_back(nd.pos);
+    }
+    if (out->init.size() > kMaxExprRegisters) {
+        return false;
+    }
+
+    expr_instr ret {};
+    ret.op = expr_opcode::ret;
+    ret.a = static_cast<std::uint16_t>(reg[t.root]);
+    out->code.push_back(ret);
+    out->pos.push_back(nodes[t.root].pos);
+    return true;
+}
+
+// add, sub, mul, neg, div and mod are inlined with the checks mathlib makes,
+// as are the shifts optimize_expr() puts in; pow, fact, binom and powmod go
+// through apply_expr_op().
+eval_result run_expr_program(const expr_program& p, std::int64_t* r)
+{
+    const expr_instr* ip = p.code.data();
+    eval_result res;
+
+#if CALC_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    // In expr_opcode order.
+    static const void* const kHandlers[] = {
+        &&op_neg,
+        &&op_add,
+        &&op_sub,
+        &&op_mul,
+        &&op_div,
+        &&op_mod,
+        &&op_slow,
+        &&op_slow,
+        &&op_slow,
+        &&op_slow,
+        &&op_shl,
+        &&op_div_pow2,
+        &&op_mod_pow2,
+        &&op_fail,
+        &&op_ret,
+    };
+#define VM_CASE(label, op) label:
+#define VM_NEXT()                                          \
+    do {                                                   \
+        ++ip;                                              \
+        goto* kHandlers[static_cast<size_t>(ip->op)];      \
+    } while (false)
+    goto* kHandlers[static_cast<size_t>(ip->op)];
+#else
+#define VM_CASE(label, op) case op:
+#define VM_NEXT() \
+    ++ip;         \
+    continue
+    for (;;) {
+        switch (ip->op) {
+#endif
+
+    VM_CASE(op_neg, expr_opcode::neg)
+    {
+        if (__builtin_sub_overflow(std::int64_t { 0 }, r[ip->a], &r[ip->dst])) {
+            res.error = eval_error::overflow;
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(op_add, expr_opcode::add)
+    {
+        if (__builtin_add_overflow(r[ip->a], r[ip->b], &r[ip->dst])) {
+            res.error = eval_error::overflow;
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(op_sub, expr_opcode::sub)
+    {
+        if (__builtin_sub_overflow(r[ip->a], r[ip->b], &r[ip->dst])) {
+            res.error = eval_error::overflow;
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(op_mul, expr_opcode::mul)
+    {
+        if (__builtin_mul_overflow(r[ip->a], r[ip->b], &r[ip->dst])) {
+            res.error = eval_error::overflow;
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(op_div, expr_opcode::div)
+    {
+        const std::int64_t a = r[ip->a];
+        const std::int64_t b = r[ip->b];
+        if (b == 0 || (a == INT64_MIN && b == -1)) {
+            res.error = b == 0 ? eval_error::div0 : eval_error::overflow;
+            goto fail;
+        }
+        r[ip->dst] = a / b;
+        VM_NEXT();
+    }
+    VM_CASE(op_mod, expr_opcode::mod)
+    {
+        const std::int64_t a = r[ip->a];
+        const std::int64_t b = r[ip->b];
+        if (b == 0) {
+            res.error = eval_error::div0;
+            goto fail;
+        }
+        r[ip->dst] = b == -1 ? 0 : a % b;
+        VM_NEXT();
+    }
+#if !CALC_COMPUTED_GOTO
+    case expr_opcode::pow:
+    case expr_opcode::fact:
+    case expr_opcode::binom:
+#endif
+    VM_CASE(op_slow, expr_opcode::powmod)
+    {
+        res.error = apply_expr_op(kind_for(ip->op), r[ip->a], r[ip->b], r[ip->c], &r[ip->dst]);
+        if (res.error != eval_error::none) {
+            goto fail;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(op_shl, expr_opcode::shl)
+    {
+        const std::int64_t a = r[ip->a];
+        const std::int64_t k = r[ip->b];
+        const auto v = static_cast<std::int64_t>(static_cast<std::uint64_t>(a) << k);
+        if ((v >> k) != a) {
+            res.error = eval_error::overflow;
+            goto fail;
+        }
+        r[ip->dst] = v;
+        VM_NEXT();
+    }
+    VM_CASE(op_div_pow2, expr_opcode::div_pow2)
+    {
+        r[ip->dst] = shift_div(r[ip->a], r[ip->b]);
+        VM_NEXT();
+    }
+    VM_CASE(op_mod_pow2, expr_opcode::mod_pow2)
+    {
+        const std::int64_t a = r[ip->a];
+        const std::int64_t k = r[ip->b];
+        r[ip->dst] = a - static_cast<std::int64_t>(static_cast<std::uint64_t>(shift_div(a, k)) << k);
+        VM_NEXT();
+    }
+    VM_CASE(op_fail, expr_opcode::fail)
+    {
+        res.error = static_cast<eval_error>(ip->a);
+        goto fail;
+    }
+    VM_CASE(op_ret, expr_opcode::ret)
+    {
+        res.value = r[ip->a];
+        return res;
+    }
+
+#if CALC_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#else
+        }
+    }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+
+fail:
+    res.pos = p.pos[static_cast<size_t>(ip - p.code.data())];
+    return res;
+}
+
+exit_code run_expr_rows(const expr_program& p, const char* data, size_t size, bool binary, out_buffer& out)
+{
+    return binary ? run_binary_rows(p, data, size, out) : run_text_rows(p, data, size, out);
+}
@@ -1,165 +1,274 @@
-#include <cerrno>
+#include <batch.h>
+#include <bigint.h>
+#include <calc.h>
+#include <columnar.h>
+#include <expr.h>
+#include <expr_opt.h>
+#include <expr_vm.h>
 #include <getopt.h>
+#include <mapped_file.h>
 #include <mathlib.h>
+#include <output.h>
+#include <sieve.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
-#include <cstdlib>
 #include <cstring>
-
-enum class operation : std::uint8_t {
-    none = 0,
-    add,
-    sub,
-    mul,
-    div,
-    pow,
-    fact
-};
-
-enum class exit_code : std::uint8_t {
-    ok = 0,
-    usage = 1,
-    math = 2
-};
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace {
 
-struct context {
-    operation op = operation::none;
-    bool have_op = false;
-
-    std::int64_t a = 0;
-    bool have_a = false;
-
-    std::int64_t b = 0;
-    bool have_b = false;
-
-    mathlib::ml_result r {};
+enum class output_format {
+    dec,
+    hex,
+    raw
 };
 
-struct op_spec {
-    const char* name;
-    operation op;
+struct options {
+    bool batch = false;
+    bool binary = false;
+    bool columnar = false;
+    bool bigint = false;
+    // -a/-b/-m are converted once the whole command line is known, since
+    // --bigint may come after them.
+    const char* a_arg = nullptr;
+    const char* b_arg = nullptr;
+    const char* m_arg = nullptr;
+    const char* input_file = nullptr;
+    const char* expr = nullptr;
+    // --vars: names bound to the values of each input row.
+    const char* vars = nullptr;
+    output_format output = output_format::dec;
+    batch_options batch_opts {};
 };
 
-constexpr op_spec kOps[] = {
-    { "add", operation::add },
-    { "sub", operation::sub },
-    { "mul", operation::mul },
-    { "div", operation::div },
-    { "pow", operation::pow },
-    { "fact", operation::fact },
-};
+constexpr int kOptBatch = 256;
+constexpr int kOptBinary = 257;
+constexpr int kOptInputFile = 258;
+constexpr int kOptThreads = 259;
+constexpr int kOptStats = 260;
+constexpr int kOptColumnar = 261;
+constexpr int kOptBigint = 262;
+constexpr int kOptOutput = 263;
+constexpr int kOptVars = 264;
 
-constexpr size_t kOpsCount = sizeof(kOps) / sizeof(kOps[0]);
+constexpr std::int64_t kMaxThreads = 1024;
 
 void help(const char* prog)
 {
     std::printf(
         "Usage:\n"
-        "  %s -o <op> -a <int> [-b <int>]\n"
+        "  %s -o <op> -a <int> [-b <int>] [-m <int>]\n"
+        "  %s --batch < ops.txt\n"
+        "  %s [--binary] --input-file <path>\n"
+        "  %s -o add|sub|mul|powmod --columnar [--input-file <path>]\n"
+        "  %s -e <expression>\n"
+        "  %s -e <expression> --vars <name,...> [--binary] [--input-file <path>]\n"
         "\n"
         "Operations:\n"
-        "  add   a + b\n"
-        "  sub   a - b\n"
-        "  mul   a * b\n"
-        "  div   a / b   (checks division by 0)\n"
-        "  pow   a ^ b   (b must be >= 0)\n"
-        "  fact  a!      (a must be >= 0)\n"
+        "  add         a + b\n"
+        "  sub         a - b\n"
+        "  mul         a * b\n"
+        "  div         a / b   (checks division by 0)\n"
+        "  pow         a ^ b   (b must be >= 0)\n"
+        "  fact        a!      (a must be >= 0)\n"
+        "  bigmul      a * b, exact for integers of any length\n"
+        "  mod         a %% b   (remainder of div; sign of a)\n"
+        "  divmod      a / b and a %% b, printed as 'quotient remainder'\n"
+        "  bigpow      a ^ b, exact for integers of any length (b must be >= 0)\n"
+        "  powmod      a ^ b mod m, in [0, m) (b >= 0, m > 0; any length with --bigint)\n"
+        "  isprime     1 if a is prime, else 0 (deterministic for 64-bit a)\n"
+        "  factor      prime factors of a >= 1, ascending and space-separated\n"
+        "  primecount  number of primes in [a, b] (0 <= a <= b <= 10^14)\n"
+        "  primes      the primes in [a, b], one per line\n"
+        "  binom       C(a, b), a choose b (a, b >= 0; 0 when b > a)\n"
         "\n"
         "Options:\n"
         "  -o, --op     operation name\n"
         "  -a, --a      first integer\n"
-        "  -b, --b      second integer (required for add/sub/mul/div/pow)\n"
+        "  -b, --b      second integer (required for all ops but fact, isprime, factor)\n"
+        "  -m, --m      modulus (powmod only)\n"
+        "  -e, --expr   evaluate an int64 expression: + - * / %% ^, unary -, postfix !,\n"
+        "               parentheses and pow(a, b), fact(a), binom(n, k), powmod(a, b, m)\n"
+        "  --vars <name,...>\n"
+        "               compile -e over these variables and evaluate it for every input\n"
+        "               row: one integer per variable on each line, one result per line\n"
+        "               (--binary: records of little-endian int64 values)\n"
+        "  --batch      read '<op> <a> [<b> [<m>]]' lines from stdin, one result per line\n"
+        "  --binary     like --batch, but with fixed-width binary records\n"
+        "  --input-file <path>\n"
+        "               like --batch, but map <path> into memory instead of reading stdin\n"
+        "  --threads <n>\n"
+        "               evaluate batch input, or sieve for primecount/primes, on n\n"
+        "               threads (0: one per CPU)\n"
+        "  --stats      print per-thread scheduler statistics to stderr\n"
+        "  --columnar   apply -o to two binary int64 columns (a..., b...) with SIMD\n"
+        "               kernels (powmod: three, a..., b..., m...); writes the result\n"
+        "               column and an overflow bitmap\n"
+        "  --bigint     exact arbitrary-precision operands and results\n"
+        "               (single operation or text --batch)\n"
+        "  --output dec|hex|raw\n"
+        "               single-operation result format: decimal (default), base 16,\n"
+        "               or a little-endian binary record with a kind/error/size header\n"
         "  -h, --help   show this help\n"
         "\n"
         "Examples:\n"
         "  %s -o add  -a 2  -b 3\n"
-        "  %s -o fact -a 5\n",
-        prog, prog, prog);
+        "  %s -o fact -a 5\n"
+        "  %s -e \"(2+3)*7^4 - 5!\"\n"
+        "  %s -e \"a*b + c\" --vars a,b,c < rows.txt\n",
+        prog, prog, prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
-bool needs_b(operation op)
+exit_code print_math_err(const char* where, mathlib::ml_error e)
 {
-    return op == operation::add || op == operation::sub || op == operation::mul || op == operation::div || op == operation::pow;
+    std::fprintf(stderr, "Error: %s: %s\n", where, math_err_str(e));
+    return exit_code::math;
 }
 
-bool parse_i64(const char* s, std::int64_t* out)
+// --output raw: one record as described at kRawHeaderSize; big is null
+// unless the value is a bigint.
+void put_raw(out_buffer& out, const mathlib::ml_result& r, const bigint* big)
 {
-    if (!s || !out) {
-        return false;
+    wire_kind kind = r.kind == mathlib::ml_kind::i64 ? wire_kind::i64 : wire_kind::u64;
+    bool negative = kind == wire_kind::i64 && r.value.i64 < 0;
+    if (big) {
+        kind = wire_kind::big;
+        negative = big->is_negative();
     }
+    const bool ok = r.error == mathlib::ml_error::ok;
 
-    errno = 0;
-    char* end = nullptr;
-    long long v = std::strtoll(s, &end, 10);
-
-    if (end == s || *end != '\0') {
-        return false;
-    }
-    if (errno == ERANGE) {
-        return false;
+    out.put(static_cast<char>(kind));
+    out.put(static_cast<char>(to_wire(r.error)));
+    out.put(static_cast<char>(ok && negative ? 1 : 0));
+    if (!ok) {
+        out.put_le64(0);
+    } else if (big) {
+        out.put_le64(8 * big->size());
+        for (size_t i = 0; i < big->size(); ++i) {
+            out.put_le64(big->data()[i]);
+        }
+    } else {
+        out.put_le64(8);
+        out.put_le64(kind == wire_kind::i64 ? static_cast<std::uint64_t>(r.value.i64) : r.value.u64);
     }
-
-    *out = static_cast<std::int64_t>(v);
-    return true;
 }
 
-bool parse_op(const char* s, operation* out)
+// One value in decimal or hexadecimal, without a newline.
+void put_text(out_buffer& out, const mathlib::ml_result& r, const bigint* big, output_format format)
 {
-    if (!s || !out) {
-        return false;
-    }
-    for (size_t i = 0; i < kOpsCount; ++i) {
-        if (std::strcmp(s, kOps[i].name) == 0) {
-            *out = kOps[i].op;
-            return true;
+    if (big) {
+        const std::string digits = format == output_format::hex ? big->to_hex() : big->to_string();
+        out.write(digits.data(), digits.size());
+    } else if (format == output_format::hex) {
+        char buf[kMaxHexChars + 1];
+        char* p = buf;
+        std::uint64_t v = r.value.u64;
+        if (r.kind == mathlib::ml_kind::i64) {
+            v = static_cast<std::uint64_t>(r.value.i64);
+            if (r.value.i64 < 0) {
+                *p++ = '-';
+                v = 0 - v;
+            }
         }
+        p = format_hex_u64(v, p);
+        out.write(buf, static_cast<size_t>(p - buf));
+    } else if (r.kind == mathlib::ml_kind::i64) {
+        out.put_i64(r.value.i64);
+    } else {
+        out.put_u64(r.value.u64);
     }
-    return false;
 }
 
-exit_code print_math_err(const char* where, mathlib::ml_error e)
+// One u64 value per prime factor: space-separated text, or one raw record
+// each.
+void put_factors(out_buffer& out, const std::vector<std::uint64_t>& factors, output_format format)
 {
-    if (e == mathlib::ml_error::div0) {
-        std::fprintf(stderr, "Error: %s: division by zero\n", where);
-    } else if (e == mathlib::ml_error::overflow) {
-        std::fprintf(stderr, "Error: %s: overflow\n", where);
-    } else {
-        std::fprintf(stderr, "Error: %s: math error\n", where);
+    mathlib::ml_result f {};
+    f.kind = mathlib::ml_kind::u64;
+    f.error = mathlib::ml_error::ok;
+    for (size_t i = 0; i < factors.size(); ++i) {
+        f.value.u64 = factors[i];
+        if (format == output_format::raw) {
+            put_raw(out, f, nullptr);
+            continue;
+        }
+        if (i != 0) {
+            out.put(' ');
+        }
+        put_text(out, f, nullptr, format);
     }
-    return exit_code::math;
 }
 
-exit_code print_result(const mathlib::ml_result& r)
+exit_code print_result(out_buffer& out, const context& c, output_format format)
 {
+    const mathlib::ml_result& r = c.r;
+    if (c.op == operation::factor && r.error == mathlib::ml_error::ok) {
+        put_factors(out, c.factors, format);
+        if (format != output_format::raw) {
+            out.put('\n');
+        }
+        return exit_code::ok;
+    }
+    // divmod prints the quotient and the remainder: separated by a space in
+    // text formats, as two records in raw.
+    const bool pair = c.op == operation::divmod;
+    if (format == output_format::raw) {
+        put_raw(out, r, c.big ? &c.big_r : nullptr);
+        if (pair) {
+            put_raw(out, r.error == mathlib::ml_error::ok ? c.r2 : r, c.big ? &c.big_r2 : nullptr);
+        }
+    }
     if (r.error != mathlib::ml_error::ok) {
         return print_math_err("calc", r.error);
     }
-
-    if (r.kind == mathlib::ml_kind::i64) {
-        std::printf("%lld\n", static_cast<long long>(r.value.i64));
-    } else {
-        std::printf("%llu\n", static_cast<unsigned long long>(r.value.u64));
+    if (format == output_format::raw) {
+        return exit_code::ok;
     }
 
+    put_text(out, r, c.big ? &c.big_r : nullptr, format);
+    if (pair) {
+        out.put(' ');
+        put_text(out, c.r2, c.big ? &c.big_r2 : nullptr, format);
+    }
+    out.put('\n');
     return exit_code::ok;
 }
 
-exit_code parse(context& c, int argc, char** argv)
+bool parse_operand(const char* s, bool big, std::int64_t* v, bigint* bv)
+{
+    return big ? bigint::parse(s, std::strlen(s), bv) : parse_i64(s, v);
+}
+
+exit_code parse(context& c, options& o, int argc, char** argv)
 {
     const option long_opts[] = {
         { "op", required_argument, nullptr, 'o' },
         { "a", required_argument, nullptr, 'a' },
         { "b", required_argument, nullptr, 'b' },
+        { "m", required_argument, nullptr, 'm' },
+        { "expr", required_argument, nullptr, 'e' },
+        { "batch", no_argument, nullptr, kOptBatch },
+        { "binary", no_argument, nullptr, kOptBinary },
+        { "input-file", required_argument, nullptr, kOptInputFile },
+        { "threads", required_argument, nullptr, kOptThreads },
+        { "stats", no_argument, nullptr, kOptStats },
+        { "columnar", no_argument, nullptr, kOptColumnar },
+        { "bigint", no_argument, nullptr, kOptBigint },
+        { "output", required_argument, nullptr, kOptOutput },
+        { "vars", required_argument, nullptr, kOptVars },
         { "help", no_argument, nullptr, 'h' },
         { nullptr, 0, nullptr, 0 },
     };
 
     opterr = 0;
     int ch = 0;
-    while ((ch = getopt_long(argc, argv, "o:a:b:h", long_opts, nullptr)) != -1) {
+    while ((ch = getopt_long(argc, argv, "o:a:b:m:e:h", long_opts, nullptr)) != -1) {
         switch (ch) {
         case 'o': {
             c.have_op = parse_op(optarg, &c.op);
@@ -170,21 +279,73 @@ exit_code parse(context& c, int argc, char** argv)
             break;
         }
         case 'a': {
-            c.have_a = parse_i64(optarg, &c.a);
-            if (!c.have_a) {
-                std::fprintf(stderr, "Error: invalid integer for -a: '%s'\n", optarg);
+            o.a_arg = optarg;
+            break;
+        }
+        case 'b': {
+            o.b_arg = optarg;
+            break;
+        }
+        case 'm': {
+            o.m_arg = optarg;
+            break;
+        }
+        case 'e': {
+            o.expr = optarg;
+            break;
+        }
+        case kOptBatch: {
+            o.batch = true;
+            break;
+        }
+        case kOptBinary: {
+            o.batch = true;
+            o.binary = true;
+            break;
+        }
+        case kOptInputFile: {
+            o.batch = true;
+            o.input_file = optarg;
+            break;
+        }
+        case kOptThreads: {
+            std::int64_t n = 0;
+            if (!parse_i64(optarg, &n) || n < 0 || n > kMaxThreads) {
+                std::fprintf(stderr, "Error: invalid thread count: '%s'\n", optarg);
                 return exit_code::usage;
             }
+            o.batch_opts.threads = n == 0 ? std::max(1U, std::thread::hardware_concurrency()) : static_cast<unsigned>(n);
             break;
         }
-        case 'b': {
-            c.have_b = parse_i64(optarg, &c.b);
-            if (!c.have_b) {
-                std::fprintf(stderr, "Error: invalid integer for -b: '%s'\n", optarg);
+        case kOptStats: {
+            o.batch_opts.stats = true;
+            break;
+        }
+        case kOptColumnar: {
+            o.columnar = true;
+            break;
+        }
+        case kOptBigint: {
+            o.bigint = true;
+            break;
+        }
+        case kOptOutput: {
+            if (std::strcmp(optarg, "dec") == 0) {
+                o.output = output_format::dec;
+            } else if (std::strcmp(optarg, "hex") == 0) {
+                o.output = output_format::hex;
+            } else if (std::strcmp(optarg, "raw") == 0) {
+                o.output = output_format::raw;
+            } else {
+                std::fprintf(stderr, "Error: unknown output format '%s'\n", optarg);
                 return exit_code::usage;
             }
             break;
         }
+        case kOptVars: {
+            o.vars = optarg;
+            break;
+        }
         case 'h': {
             help(argv[0]);
             return exit_code::usage;
@@ -195,91 +356,320 @@ exit_code parse(context& c, int argc, char** argv)
         }
         }
     }
+
+    c.big = o.bigint || (c.have_op && is_big_op(c.op));
+    if (o.a_arg) {
+        c.have_a = parse_operand(o.a_arg, c.big, &c.a, &c.big_a);
+        if (!c.have_a) {
+            std::fprintf(stderr, "Error: invalid integer for -a: '%s'\n", o.a_arg);
+            return exit_code::usage;
+        }
+    }
+    if (o.b_arg) {
+        c.have_b = parse_operand(o.b_arg, c.big, &c.b, &c.big_b);
+        if (!c.have_b) {
+            std::fprintf(stderr, "Error: invalid integer for -b: '%s'\n", o.b_arg);
+            return exit_code::usage;
+        }
+    }
+    if (o.m_arg) {
+        c.have_m = parse_operand(o.m_arg, c.big, &c.m, &c.big_m);
+        if (!c.have_m) {
+            std::fprintf(stderr, "Error: invalid integer for -m: '%s'\n", o.m_arg);
+            return exit_code::usage;
+        }
+    }
     return exit_code::ok;
 }
 
 exit_code check(const context& c, const char* prog)
 {
-    if (!c.have_op || !c.have_a) {
+    switch (validate(c)) {
+    case check_error::none: {
+        return exit_code::ok;
+    }
+    case check_error::missing_operand: {
         std::fprintf(stderr, "Error: missing -o or -a\n");
         help(prog);
         return exit_code::usage;
     }
-    if (!needs_b(c.op) && c.have_b) {
+    case check_error::useless_b: {
         std::fprintf(stderr, "Error: useless -b for this op\n");
         help(prog);
         return exit_code::usage;
     }
-    if (needs_b(c.op) && !c.have_b) {
+    case check_error::missing_b: {
         std::fprintf(stderr, "Error: missing -b for this op\n");
         help(prog);
         return exit_code::usage;
     }
-    if (c.op == operation::pow && c.b < 0) {
+    case check_error::pow_domain: {
         std::fprintf(stderr, "Error: pow: domain error (b must be >= 0)\n");
         return exit_code::math;
     }
-    if (c.op == operation::fact && c.a < 0) {
+    case check_error::missing_m: {
+        std::fprintf(stderr, "Error: missing -m for this op\n");
+        help(prog);
+        return exit_code::usage;
+    }
+    case check_error::useless_m: {
+        std::fprintf(stderr, "Error: useless -m for this op\n");
+        help(prog);
+        return exit_code::usage;
+    }
+    case check_error::powmod_domain: {
+        std::fprintf(stderr, "Error: powmod: domain error (b must be >= 0, m > 0)\n");
+        return exit_code::math;
+    }
+    case check_error::factor_domain: {
+        std::fprintf(stderr, "Error: factor: domain error (a must be >= 1)\n");
+        return exit_code::math;
+    }
+    case check_error::sieve_domain: {
+        std::fprintf(stderr, "Error: sieve: domain error (0 <= a <= b <= 10^14)\n");
+        return exit_code::math;
+    }
+    case check_error::binom_domain: {
+        std::fprintf(stderr, "Error: binom: domain error (n and k must be >= 0)\n");
+        return exit_code::math;
+    }
+    case check_error::fact_domain:
+    default: {
         std::fprintf(stderr, "Error: fact: domain error (a must be >= 0)\n");
         return exit_code::math;
     }
-    return exit_code::ok;
+    }
 }
 
-exit_code calc(context& c)
+exit_code run_input_file(const options& o, out_buffer& out)
 {
-    switch (c.op) {
-    case operation::add: {
-        c.r = mathlib::ml_add(c.a, c.b);
-        break;
+    mapped_file f;
+    if (!f.open(o.input_file)) {
+        std::fprintf(stderr, "Error: cannot open '%s': %s\n", o.input_file, std::strerror(errno));
+        return exit_code::usage;
     }
-    case operation::sub: {
-        c.r = mathlib::ml_sub(c.a, c.b);
-        break;
+    if (o.binary) {
+        return run_batch_binary_buffer(f.data(), f.size(), out, o.batch_opts);
     }
-    case operation::mul: {
-        c.r = mathlib::ml_mul(c.a, c.b);
-        break;
+    return run_batch_buffer(f.data(), f.size(), out, o.batch_opts);
+}
+
+bool read_all(std::FILE* in, std::vector<char>& buf)
+{
+    char block[1 << 16];
+    size_t got = 0;
+    while ((got = std::fread(block, 1, sizeof(block), in)) > 0) {
+        buf.insert(buf.end(), block, block + got);
     }
-    case operation::div: {
-        c.r = mathlib::ml_div(c.a, c.b);
-        break;
+    return std::ferror(in) == 0;
+}
+
+exit_code run_columnar_mode(const context& c, const options& o, out_buffer& out)
+{
+    if (!c.have_op || !columnar_supported(c.op) || c.have_a || c.have_b || c.have_m || o.binary || o.bigint) {
+        std::fprintf(stderr, "Error: --columnar needs -o add|sub|mul|powmod and no -a/-b/-m/--binary/--bigint\n");
+        return exit_code::usage;
     }
-    case operation::pow: {
-        c.r = mathlib::ml_pow(c.a, static_cast<std::uint64_t>(c.b));
-        break;
+    if (o.input_file) {
+        mapped_file f;
+        if (!f.open(o.input_file)) {
+            std::fprintf(stderr, "Error: cannot open '%s': %s\n", o.input_file, std::strerror(errno));
+            return exit_code::usage;
+        }
+        return run_columnar(c.op, f.data(), f.size(), out);
     }
-    case operation::fact: {
-        c.r = mathlib::ml_fact(static_cast<std::uint64_t>(c.a));
-        break;
+
+    std::vector<char> buf;
+    if (!read_all(stdin, buf)) {
+        std::fprintf(stderr, "Error: columnar: I/O error\n");
+        return exit_code::usage;
     }
-    case operation::none:
-    default: {
-        std::fprintf(stderr, "Error: unknown operation\n");
+    return run_columnar(c.op, buf.data(), buf.size(), out);
+}
+
+exit_code run_primes(const context& c, const options& o, out_buffer& out)
+{
+    if (o.output != output_format::dec) {
+        std::fprintf(stderr, "Error: primes prints decimal lines only\n");
         return exit_code::usage;
     }
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+    sieve_range(c, &a, &b);
+    if (!write_primes(a, b, c.threads, out) || !out.flush()) {
+        std::fprintf(stderr, "Error: primes: I/O error\n");
+        return exit_code::usage;
     }
     return exit_code::ok;
 }
 
+// The message for byte offset pos of the expression s, with a caret under it.
+void print_expr_err(const char* s, size_t pos, const char* message)
+{
+    std::fprintf(stderr, "Error: expr: %s at column %zu\n  %s\n  %*s^\n", message, pos + 1, s, static_cast<int>(pos), "");
+}
+
+// Comma-separated, distinct names.
+bool parse_vars(const char* s, std::vector<std::string>* out)
+{
+    for (const char* p = s;;) {
+        const char* comma = std::strchr(p, ',');
+        const size_t n = comma != nullptr ? static_cast<size_t>(comma - p) : std::strlen(p);
+        if (!is_expr_name(p, n) || std::find(out->begin(), out->end(), std::string(p, n)) != out->end()) {
+            return false;
+        }
+        out->emplace_back(p, n);
+        if (comma == nullptr) {
+            return true;
+        }
+        p = comma + 1;
+    }
+}
+
+exit_code run_expr_rows_mode(const options& o, const expr_tree& t, size_t vars, out_buffer& out)
+{
+    expr_tree opt;
+    optimize_expr(t, &opt);
+    expr_program p;
+    if (!compile_expr(opt, vars, &p)) {
+        std::fprintf(stderr, "Error: expr: expression too large to compile\n");
+        return exit_code::usage;
+    }
+    if (o.input_file) {
+        mapped_file f;
+        if (!f.open(o.input_file)) {
+            std::fprintf(stderr, "Error: cannot open '%s': %s\n", o.input_file, std::strerror(errno));
+            return exit_code::usage;
+        }
+        return run_expr_rows(p, f.data(), f.size(), o.binary, out);
+    }
+
+    std::vector<char> buf;
+    if (!read_all(stdin, buf)) {
+        std::fprintf(stderr, "Error: expr: I/O error\n");
+        return exit_code::usage;
+    }
+    return run_expr_rows(p, buf.data(), buf.size(), o.binary, out);
+}
+
+exit_code run_expr(const options& o, out_buffer& out)
+{
+    std::vector<std::string> vars;
+    if (o.vars && !parse_vars(o.vars, &vars)) {
+        std::fprintf(stderr, "Error: invalid variable list '%s'\n", o.vars);
+        return exit_code::usage;
+    }
+    expr_tree t;
+    expr_parse_error perr;
+    if (!parse_expr(o.expr, std::strlen(o.expr), vars, &t, &perr)) {
+        print_expr_err(o.expr, perr.pos, perr.message.c_str());
+        return exit_code::usage;
+    }
+    if (o.vars) {
+        return run_expr_rows_mode(o, t, vars.size(), out);
+    }
+
+    const eval_result v = eval_expr(t, nullptr);
+    mathlib::ml_result r {};
+    r.kind = mathlib::ml_kind::i64;
+    r.error = mathlib::ml_error::ok;
+    r.value.i64 = v.value;
+    exit_code rc = exit_code::ok;
+    if (v.error == eval_error::none) {
+        if (o.output == output_format::raw) {
+            put_raw(out, r, nullptr);
+        } else {
+            put_text(out, r, nullptr, o.output);
+            out.put('\n');
+        }
+    } else {
+        // Domain errors have no mathlib code, so raw output only records
+        // division by zero and overflow, as for single operations.
+        if (o.output == output_format::raw && v.error != eval_error::domain) {
+            r.error = v.error == eval_error::div0 ? mathlib::ml_error::div0 : mathlib::ml_error::overflow;
+            put_raw(out, r, nullptr);
+        }
+        print_expr_err(o.expr, v.pos, eval_err_str(v.error));
+        rc = exit_code::math;
+    }
+    if (!out.flush()) {
+        std::fprintf(stderr, "Error: expr: I/O error\n");
+        return exit_code::usage;
+    }
+    return rc;
+}
+
 int run(int argc, char** argv)
 {
     context c {};
-    exit_code rc = parse(c, argc, argv);
+    options o {};
+    exit_code rc = parse(c, o, argc, argv);
     if (rc != exit_code::ok) {
         return static_cast<int>(rc);
     }
 
+    if ((o.batch || o.columnar) && o.output != output_format::dec) {
+        std::fprintf(stderr, "Error: --output applies to single operations only\n");
+        return static_cast<int>(exit_code::usage);
+    }
+
+    out_buffer out(STDOUT_FILENO);
+    if (o.expr) {
+        if (c.have_op || c.have_a || c.have_b || c.have_m || o.columnar || o.bigint) {
+            std::fprintf(stderr, "Error: -e cannot be combined with -o/-a/-b/-m, --columnar or --bigint\n");
+            return static_cast<int>(exit_code::usage);
+        }
+        if (o.vars ? o.output != output_format::dec : o.batch) {
+            std::fprintf(stderr, "Error: -e reads input rows with --vars only, and writes them in the batch formats\n");
+            return static_cast<int>(exit_code::usage);
+        }
+        return static_cast<int>(run_expr(o, out));
+    }
+    if (o.vars) {
+        std::fprintf(stderr, "Error: --vars needs -e\n");
+        return static_cast<int>(exit_code::usage);
+    }
+
+    if (o.columnar) {
+        return static_cast<int>(run_columnar_mode(c, o, out));
+    }
+
+    if (o.batch) {
+        if (c.have_op || c.have_a || c.have_b || c.have_m) {
+            std::fprintf(stderr, "Error: -o/-a/-b/-m cannot be combined with --batch\n");
+            return static_cast<int>(exit_code::usage);
+        }
+        if (o.bigint && o.binary) {
+            std::fprintf(stderr, "Error: --bigint cannot be combined with --binary\n");
+            return static_cast<int>(exit_code::usage);
+        }
+        o.batch_opts.bigint = o.bigint;
+        if (o.input_file) {
+            return static_cast<int>(run_input_file(o, out));
+        }
+        return static_cast<int>(o.binary ? run_batch_binary(stdin, out, o.batch_opts) : run_batch(stdin, out, o.batch_opts));
+    }
+
     rc = check(c, argv[0]);
     if (rc != exit_code::ok) {
         return static_cast<int>(rc);
     }
 
+    c.threads = o.batch_opts.threads;
+    if (c.op == operation::primes) {
+        return static_cast<int>(run_primes(c, o, out));
+    }
+
     rc = calc(c);
     if (rc != exit_code::ok) {
         return static_cast<int>(rc);
     }
-    return static_cast<int>(print_result(c.r));
+    rc = print_result(out, c, o.output);
+    if (!out.flush()) {
+        std::fprintf(stderr, "Error: calc: I/O error\n");
+        return static_cast<int>(exit_code::usage);
+    }
+    return static_cast<int>(rc);
 }
 
 } // namespace
@@ -0,0 +1,54 @@
+#include <mapped_file.h>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mapped_file::~mapped_file()
+{
+    if (addr_ != nullptr) {
+        ::munmap(addr_, size_);
+    }
+}
+
+bool mapped_file::open(const char* path)
+{
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        const int saved = errno;
+        ::close(fd);
+        errno = saved;
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ::close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    const auto size = static_cast<size_t>(st.st_size);
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int saved = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        errno = saved;
+        return false;
+    }
+
+    ::madvise(addr, size, MADV_SEQUENTIAL);
+    ::madvise(addr, size, MADV_WILLNEED);
+    addr_ = addr;
+    size_ = size;
+    return true;
+}
@@ -0,0 +1,47 @@
+#include <modarith.h>
+
+montgomery64::montgomery64(std::uint64_t m)
+    : m_(m)
+    , inv_(m)
+{
+    // Newton's iteration for m^-1 mod 2^64: m is its own inverse mod 8 and
+    // every step doubles the number of correct low bits.
+    for (int i = 0; i < 5; ++i) {
+        inv_ *= 2 - m * inv_;
+    }
+    one_ = (0 - m) % m;
+    r2_ = static_cast<std::uint64_t>(static_cast<u128>(one_) * one_ % m);
+}
+
+std::uint64_t montgomery64::pow(std::uint64_t x, std::uint64_t e) const
+{
+    std::uint64_t r = one_;
+    for (; e != 0; e >>= 1) {
+        if ((e & 1) != 0) {
+            r = mul(r, x);
+        }
+        x = mul(x, x);
+    }
+    return r;
+}
+
+std::uint64_t barrett64::pow(std::uint64_t x, std::uint64_t e) const
+{
+    std::uint64_t r = m_ == 1 ? 0 : 1;
+    for (; e != 0; e >>= 1) {
+        if ((e & 1) != 0) {
+            r = mul(r, x);
+        }
+        x = mul(x, x);
+    }
+    return r;
+}
+
+std::uint64_t powmod_u64(std::uint64_t a, std::uint64_t e, std::uint64_t m)
+{
+    if ((m & 1) != 0) {
+        const montgomery64 mont(m);
+        return mont.from(mont.pow(mont.to(a), e));
+    }
+    return barrett64(m).pow(a % m, e);
+}
@@ -0,0 +1,148 @@
+#include <output.h>
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kDigitPairs[] = "00010203040506070809"
+                               "10111213141516171819"
+                               "20212223242526272829"
+                               "30313233343536373839"
+                               "40414243444546474849"
+                               "50515253545556575859"
+                               "60616263646566676869"
+                               "70717273747576777879"
+                               "80818283848586878889"
+                               "90919293949596979899";
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+} // namespace
+
+char* format_u64(std::uint64_t v, char* out)
+{
+    char tmp[kMaxIntChars];
+    char* p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        const auto pair = static_cast<size_t>(v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        std::memcpy(p, kDigitPairs + pair, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        std::memcpy(p, kDigitPairs + static_cast<size_t>(v) * 2, 2);
+    } else {
+        *--p = static_cast<char>('0' + v);
+    }
+
+    const auto n = static_cast<size_t>(tmp + sizeof(tmp) - p);
+    std::memcpy(out, p, n);
+    return out + n;
+}
+
+char* format_i64(std::int64_t v, char* out)
+{
+    if (v < 0) {
+        *out++ = '-';
+        return format_u64(0 - static_cast<std::uint64_t>(v), out);
+    }
+    return format_u64(static_cast<std::uint64_t>(v), out);
+}
+
+char* format_hex_u64(std::uint64_t v, char* out)
+{
+    const int digits = v == 0 ? 1 : (67 - __builtin_clzll(v)) / 4;
+    for (int i = digits - 1; i >= 0; --i) {
+        out[i] = kHexDigits[v & 0xf];
+        v >>= 4;
+    }
+    return out + digits;
+}
+
+out_buffer::out_buffer(int fd, size_t capacity)
+    : fd_(fd)
+    , buf_(capacity < kMaxIntChars + 1 ? kMaxIntChars + 1 : capacity)
+{
+}
+
+out_buffer::~out_buffer()
+{
+    flush();
+}
+
+void out_buffer::write(const void* data, size_t n)
+{
+    const auto* p = static_cast<const char*>(data);
+    if (n >= buf_.size()) {
+        flush();
+        failed_ = !drain(p, n) || failed_;
+        return;
+    }
+    reserve(n);
+    std::memcpy(buf_.data() + used_, p, n);
+    used_ += n;
+}
+
+void out_buffer::put(char ch)
+{
+    reserve(1);
+    buf_[used_++] = ch;
+}
+
+void out_buffer::put_i64(std::int64_t v)
+{
+    reserve(kMaxIntChars);
+    used_ = static_cast<size_t>(format_i64(v, buf_.data() + used_) - buf_.data());
+}
+
+void out_buffer::put_u64(std::uint64_t v)
+{
+    reserve(kMaxIntChars);
+    used_ = static_cast<size_t>(format_u64(v, buf_.data() + used_) - buf_.data());
+}
+
+void out_buffer::put_le64(std::uint64_t v)
+{
+    reserve(8);
+    for (size_t i = 0; i < 8; ++i) {
+        buf_[used_++] = static_cast<char>(v >> (8 * i));
+    }
+}
+
+bool out_buffer::flush()
+{
+    if (used_ > 0) {
+        failed_ = !drain(buf_.data(), used_) || failed_;
+        used_ = 0;
+    }
+    return !failed_;
+}
+
+void out_buffer::reserve(size_t n)
+{
+    if (buf_.size() - used_ < n) {
+        flush();
+    }
+}
+
+bool out_buffer::drain(const char* p, size_t n)
+{
+    if (failed_) {
+        return false;
+    }
+    while (n > 0) {
+        const ssize_t w = ::write(fd_, p, n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
@@ -0,0 +1,243 @@
+#include <primes.h>
+
+#include <modarith.h>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+// With inv = p^-1 mod 2^64, n is a multiple of an odd p exactly when
+// n inv mod 2^64 <= (2^64 - 1) / p, since multiplying by inv maps the
+// multiples of p onto [0, (2^64 - 1) / p]; n inv is then also n / p. This
+// avoids a division.
+struct small_prime {
+    std::uint32_t p;
+    std::uint64_t inv;
+    std::uint64_t limit;
+};
+
+// Odd primes below kSmallPrimeLimit, used for trial division.
+constexpr std::uint32_t kSmallPrimeLimit = 1024;
+constexpr size_t kSmallPrimeCount = 171;
+
+struct small_prime_table {
+    small_prime e[kSmallPrimeCount];
+};
+
+constexpr small_prime_table make_small_primes()
+{
+    bool composite[kSmallPrimeLimit] = {};
+    small_prime_table t {};
+    size_t count = 0;
+    for (std::uint32_t p = 3; p < kSmallPrimeLimit; p += 2) {
+        if (composite[p]) {
+            continue;
+        }
+        for (std::uint32_t q = p * p; q < kSmallPrimeLimit; q += 2 * p) {
+            composite[q] = true;
+        }
+        std::uint64_t inv = p;
+        for (int i = 0; i < 5; ++i) {
+            inv *= 2 - p * inv;
+        }
+        t.e[count++] = { p, inv, ~std::uint64_t { 0 } / p };
+    }
+    return t;
+}
+
+constexpr small_prime_table kSmallPrimes = make_small_primes();
+static_assert(kSmallPrimes.e[kSmallPrimeCount - 1].p == 1021, "kSmallPrimeCount is off");
+
+bool divides(const small_prime& sp, std::uint64_t n)
+{
+    return n * sp.inv <= sp.limit;
+}
+
+// is_prime_u64() tries the primes up to 61 (the first 17); every n below
+// 67^2 that survives them is prime.
+constexpr size_t kIsPrimeTrialCount = 17;
+constexpr std::uint64_t kIsPrimeTrialLimit = 67 * 67;
+static_assert(kSmallPrimes.e[kIsPrimeTrialCount].p == 67, "kIsPrimeTrialLimit is off");
+
+// Bases with no strong pseudoprimes below 2^32 (Jaeschke) and below 2^64
+// (Sinclair).
+constexpr std::uint64_t kBases32[] = { 2, 7, 61 };
+constexpr std::uint64_t kBases64[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+
+// Steps of Brent's cycle search between two gcds.
+constexpr int kRhoBatch = 128;
+
+// Strong probable-prime test of odd n > 2 to each of the N bases, where
+// n - 1 = d 2^s. The bases are raised to d in lockstep: their Montgomery
+// chains are independent, so the multiplications overlap in the pipeline
+// instead of each waiting on the previous one.
+template <size_t N>
+bool strong_probable_prime(const montgomery64& mont, const std::uint64_t* bases, std::uint64_t d, int s)
+{
+    const std::uint64_t n = mont.modulus();
+    const std::uint64_t one = mont.one();
+    const std::uint64_t minus_one = n - one;
+
+    std::uint64_t b[N];
+    std::uint64_t x[N];
+    for (size_t k = 0; k < N; ++k) {
+        b[k] = mont.to(bases[k] % n);
+        x[k] = b[k];
+    }
+    for (int i = 62 - __builtin_clzll(d); i >= 0; --i) {
+        for (size_t k = 0; k < N; ++k) {
+            x[k] = mont.mul(x[k], x[k]);
+        }
+        if (((d >> i) & 1) != 0) {
+            for (size_t k = 0; k < N; ++k) {
+                x[k] = mont.mul(x[k], b[k]);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < N; ++k) {
+        // A base that is a multiple of n says nothing about n.
+        if (b[k] == 0 || x[k] == one || x[k] == minus_one) {
+            continue;
+        }
+        int i = 1;
+        for (; i < s; ++i) {
+            x[k] = mont.mul(x[k], x[k]);
+            if (x[k] == minus_one) {
+                break;
+            }
+        }
+        if (i == s) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Most composites already fail base 2, so it runs alone and the remaining
+// bases, which only primes and strong pseudoprimes reach, run together.
+template <size_t N>
+bool miller_rabin(std::uint64_t n, const std::uint64_t (&bases)[N])
+{
+    static_assert(N > 1, "base 2 runs alone");
+    const montgomery64 mont(n);
+    const int s = __builtin_ctzll(n - 1);
+    const std::uint64_t d = (n - 1) >> s;
+    return strong_probable_prime<1>(mont, bases, d, s) && strong_probable_prime<N - 1>(mont, bases + 1, d, s);
+}
+
+// Binary gcd; b must be odd.
+std::uint64_t gcd_odd(std::uint64_t a, std::uint64_t b)
+{
+    while (a != 0) {
+        a >>= __builtin_ctzll(a);
+        if (a < b) {
+            std::swap(a, b);
+        }
+        a -= b;
+    }
+    return b;
+}
+
+// A nontrivial factor of an odd composite n by Pollard's rho with Brent's
+// cycle detection on x -> x^2 + c in Montgomery form. The differences of
+// kRhoBatch steps are multiplied together so that a single gcd covers them;
+// if that gcd overshoots to n, the batch is replayed one step at a time.
+std::uint64_t pollard_brent(std::uint64_t n)
+{
+    const montgomery64 mont(n);
+    const auto diff = [](std::uint64_t x, std::uint64_t y) { return x > y ? x - y : y - x; };
+    for (std::uint64_t c = 1;; ++c) {
+        const std::uint64_t cm = mont.to(c);
+        const auto step = [&](std::uint64_t x) { return mont.add(mont.mul(x, x), cm); };
+        std::uint64_t y = mont.to(2);
+        std::uint64_t x = y;
+        std::uint64_t ys = y;
+        std::uint64_t q = mont.one();
+        std::uint64_t g = 1;
+        for (std::uint64_t r = 1; g == 1; r *= 2) {
+            x = y;
+            for (std::uint64_t i = 0; i < r; ++i) {
+                y = step(y);
+            }
+            for (std::uint64_t k = 0; k < r && g == 1; k += kRhoBatch) {
+                ys = y;
+                const std::uint64_t steps = std::min<std::uint64_t>(kRhoBatch, r - k);
+                for (std::uint64_t i = 0; i < steps; ++i) {
+                    y = step(y);
+                    q = mont.mul(q, diff(x, y));
+                }
+                g = gcd_odd(q, n);
+            }
+        }
+        if (g == n) {
+            do {
+                ys = step(ys);
+                g = gcd_odd(diff(x, ys), n);
+            } while (g == 1);
+        }
+        if (g != n) {
+            return g;
+        }
+    }
+}
+
+// Appends the prime factors of n > 1, which has no factor below
+// kSmallPrimeLimit, in no particular order.
+void factor_large(std::uint64_t n, std::vector<std::uint64_t>& out)
+{
+    if (n < std::uint64_t { kSmallPrimeLimit } * kSmallPrimeLimit || is_prime_u64(n)) {
+        out.push_back(n);
+        return;
+    }
+    const std::uint64_t d = pollard_brent(n);
+    factor_large(d, out);
+    factor_large(n / d, out);
+}
+
+} // namespace
+
+bool is_prime_u64(std::uint64_t n)
+{
+    if (n < 2) {
+        return false;
+    }
+    if ((n & 1) == 0) {
+        return n == 2;
+    }
+    for (size_t i = 0; i < kIsPrimeTrialCount; ++i) {
+        if (divides(kSmallPrimes.e[i], n)) {
+            return n == kSmallPrimes.e[i].p;
+        }
+    }
+    if (n < kIsPrimeTrialLimit) {
+        return true;
+    }
+    return n >> 32 == 0 ? miller_rabin(n, kBases32) : miller_rabin(n, kBases64);
+}
+
+std::vector<std::uint64_t> factor_u64(std::uint64_t n)
+{
+    std::vector<std::uint64_t> out;
+    if (n == 0) {
+        return out;
+    }
+    const int twos = __builtin_ctzll(n);
+    out.assign(static_cast<size_t>(twos), 2);
+    n >>= twos;
+    for (const small_prime& sp : kSmallPrimes.e) {
+        if (std::uint64_t { sp.p } * sp.p > n) {
+            break;
+        }
+        while (divides(sp, n)) {
+            out.push_back(sp.p);
+            n *= sp.inv;
+        }
+    }
+    if (n != 1) {
+        factor_large(n, out);
+        std::sort(out.begin(), out.end());
+    }
+    return out;
+}
@@ -0,0 +1,388 @@
+#include <sieve.h>
+
+#include <worker_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Bit k of a segment byte stands for 30 i + kResidues[k]; every prime above
+// 5 has one of these residues.
+constexpr std::uint8_t kResidues[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+
+// Distances between consecutive residues, wrapping from 29 to 31.
+constexpr std::uint8_t kGaps[8] = { 6, 4, 2, 4, 2, 4, 6, 2 };
+
+// Primes that the wheel and the pre-sieve pattern remove; they are reported
+// separately.
+constexpr std::uint64_t kWheelPrimes[] = { 2, 3, 5, 7, 11, 13, 17 };
+
+// The multiples of 7, 11, 13 and 17 repeat every 7 * 11 * 13 * 17 bytes, so
+// each segment starts as a copy of that pattern and sieving begins at 19.
+constexpr std::uint32_t kPresievePrimes[] = { 7, 11, 13, 17 };
+constexpr size_t kPatternBytes = 7 * 11 * 13 * 17;
+constexpr std::uint32_t kFirstSievingPrime = 19;
+
+// Segment size in bytes (30 numbers each): small enough to stay in L1 while
+// the small primes, which cross off most bits, run over it.
+constexpr size_t kSegmentBytes = size_t { 64 } << 10;
+
+// Consecutive segments per job. Each job first places every sieving prime
+// at its first multiple, which takes a division per prime, so jobs span
+// several segments.
+constexpr size_t kSegmentsPerJob = 32;
+
+// Jobs in flight per thread when printing; bounds the text held in memory.
+constexpr size_t kJobsPerThread = 2;
+
+struct bit_tables {
+    // Mask of the bit for n mod 30 (0 if n shares a factor with 30).
+    std::uint8_t bit[30];
+    // Wheel index k of n mod 30, for n coprime to 30.
+    std::uint8_t index[30];
+    // Smallest d >= 0 such that n + d is coprime to 30.
+    std::uint8_t to_next[30];
+};
+
+constexpr bit_tables make_bit_tables()
+{
+    bit_tables t {};
+    for (std::uint8_t k = 0; k < 8; ++k) {
+        t.bit[kResidues[k]] = static_cast<std::uint8_t>(1U << k);
+        t.index[kResidues[k]] = k;
+    }
+    for (int r = 29; r >= 0; --r) {
+        t.to_next[r] = t.bit[r] != 0 ? 0 : static_cast<std::uint8_t>(r == 29 ? 2 : t.to_next[r + 1] + 1);
+    }
+    return t;
+}
+
+constexpr bit_tables kBits = make_bit_tables();
+
+// With p = 30 k + kResidues[r] and a cofactor q = 30 j + kResidues[w], the
+// multiple p q lies in byte 30 k j + k kResidues[w] + j kResidues[r] +
+// floor(kResidues[r] kResidues[w] / 30), at a bit that depends on r and w
+// only. Moving q to the next residue therefore advances the byte by
+// k kGaps[w] + step[r][w], and no division is needed while crossing off.
+struct crossing_tables {
+    std::uint8_t clear[8][8];
+    std::uint8_t step[8][8];
+};
+
+constexpr crossing_tables make_crossing_tables()
+{
+    crossing_tables t {};
+    for (int r = 0; r < 8; ++r) {
+        for (int w = 0; w < 8; ++w) {
+            const int pr = kResidues[r];
+            const int q = kResidues[w];
+            const int next = w == 7 ? 31 : kResidues[w + 1];
+            t.clear[r][w] = static_cast<std::uint8_t>(~kBits.bit[pr * q % 30]);
+            t.step[r][w] = static_cast<std::uint8_t>(pr * next / 30 - pr * q / 30);
+        }
+    }
+    return t;
+}
+
+constexpr crossing_tables kCrossing = make_crossing_tables();
+
+// Next multiple p q of a sieving prime to cross off, with q coprime to 30:
+// its byte relative to the current segment, k = p / 30 and the wheel
+// indexes of p and q.
+struct crossing {
+    std::uint64_t i;
+    std::uint32_t k;
+    std::uint8_t r;
+    std::uint8_t w;
+};
+
+std::uint64_t isqrt(std::uint64_t n)
+{
+    std::uint64_t r = 0;
+    for (std::uint64_t bit = std::uint64_t { 1 } << 31; bit != 0; bit >>= 1) {
+        const std::uint64_t t = r | bit;
+        if (t * t <= n) {
+            r = t;
+        }
+    }
+    return r;
+}
+
+// Primes from kFirstSievingPrime to limit, by a plain sieve over odd numbers.
+std::vector<std::uint32_t> sieving_primes(std::uint64_t limit)
+{
+    std::vector<std::uint32_t> primes;
+    std::vector<bool> composite(static_cast<size_t>(limit / 2 + 1), false);
+    for (std::uint64_t n = 3; n <= limit; n += 2) {
+        if (composite[n / 2]) {
+            continue;
+        }
+        if (n >= kFirstSievingPrime) {
+            primes.push_back(static_cast<std::uint32_t>(n));
+        }
+        for (std::uint64_t q = n * n; q <= limit; q += 2 * n) {
+            composite[q / 2] = true;
+        }
+    }
+    return primes;
+}
+
+std::vector<std::uint8_t> presieve_pattern()
+{
+    std::vector<std::uint8_t> pattern(kPatternBytes, 0xff);
+    for (const std::uint32_t p : kPresievePrimes) {
+        for (std::uint64_t m = p; m < 30 * kPatternBytes; m += 2 * p) {
+            pattern[m / 30] &= static_cast<std::uint8_t>(~kBits.bit[m % 30]);
+        }
+    }
+    return pattern;
+}
+
+// Sieves consecutive segments starting at byte `first_byte` of the number
+// line, carrying each prime's next multiple from one segment to the next.
+class segment_sieve {
+public:
+    segment_sieve(const std::vector<std::uint32_t>& primes, const std::vector<std::uint8_t>& pattern,
+        std::uint64_t first_byte)
+        : pattern_(pattern)
+        , bytes_(kSegmentBytes)
+    {
+        const std::uint64_t lo = 30 * first_byte;
+        crossings_.reserve(primes.size());
+        for (const std::uint32_t p : primes) {
+            // The first multiple p q >= max(p^2, lo) with q coprime to 30;
+            // smaller multiples have a smaller prime factor.
+            std::uint64_t q = std::max<std::uint64_t>(p, (lo + p - 1) / p);
+            q += kBits.to_next[q % 30];
+            crossings_.push_back({ p * q / 30 - first_byte, p / 30, kBits.index[p % 30], kBits.index[q % 30] });
+        }
+    }
+
+    // Sieves the next segment, bytes [first, first + bytes), and returns it.
+    std::uint8_t* run(std::uint64_t first, size_t bytes)
+    {
+        std::uint8_t* seg = bytes_.data();
+        size_t done = 0;
+        for (size_t offset = static_cast<size_t>(first % kPatternBytes); done < bytes; offset = 0) {
+            const size_t n = std::min(bytes - done, kPatternBytes - offset);
+            std::memcpy(seg + done, pattern_.data() + offset, n);
+            done += n;
+        }
+
+        for (crossing& c : crossings_) {
+            std::uint64_t i = c.i;
+            unsigned w = c.w;
+            const std::uint8_t* clear = kCrossing.clear[c.r];
+            const std::uint8_t* step = kCrossing.step[c.r];
+            const std::uint64_t k = c.k;
+            const std::uint64_t p = 30 * k + kResidues[c.r];
+            if (i + p <= bytes) {
+                // A whole turn of the wheel advances exactly p bytes, so the
+                // eight bytes of each turn sit at fixed offsets and can be
+                // cleared independently of each other.
+                size_t offset[8];
+                std::uint8_t mask[8];
+                std::uint64_t o = 0;
+                for (unsigned j = 0; j < 8; ++j) {
+                    const unsigned v = (w + j) & 7;
+                    offset[j] = static_cast<size_t>(o);
+                    mask[j] = clear[v];
+                    o += k * kGaps[v] + step[v];
+                }
+                for (; i + p <= bytes; i += p) {
+                    std::uint8_t* b = seg + i;
+                    b[offset[0]] &= mask[0];
+                    b[offset[1]] &= mask[1];
+                    b[offset[2]] &= mask[2];
+                    b[offset[3]] &= mask[3];
+                    b[offset[4]] &= mask[4];
+                    b[offset[5]] &= mask[5];
+                    b[offset[6]] &= mask[6];
+                    b[offset[7]] &= mask[7];
+                }
+            }
+            while (i < bytes) {
+                seg[i] &= clear[w];
+                i += k * kGaps[w] + step[w];
+                w = (w + 1) & 7;
+            }
+            c.i = i - bytes;
+            c.w = static_cast<std::uint8_t>(w);
+        }
+        return seg;
+    }
+
+private:
+    const std::vector<std::uint8_t>& pattern_;
+    std::vector<std::uint8_t> bytes_;
+    std::vector<crossing> crossings_;
+};
+
+// The segments of [a, b] and what they share.
+class range_sieve {
+public:
+    range_sieve(std::uint64_t a, std::uint64_t b)
+        : a_(a)
+        , b_(b)
+        , first_(a / 30)
+        , end_(b / 30 + 1)
+        , primes_(sieving_primes(isqrt(b)))
+        , pattern_(presieve_pattern())
+    {
+    }
+
+    size_t jobs() const
+    {
+        const std::uint64_t per_job = kSegmentsPerJob * kSegmentBytes;
+        return static_cast<size_t>((end_ - first_ + per_job - 1) / per_job);
+    }
+
+    // Calls visit(seg, first, bytes) for each segment of job j in order, with
+    // the bits outside [a, b] (and the bit for 1) already cleared.
+    template <typename Visit>
+    void run(size_t job, Visit&& visit) const
+    {
+        const std::uint64_t begin = first_ + static_cast<std::uint64_t>(job) * kSegmentsPerJob * kSegmentBytes;
+        const std::uint64_t stop = std::min(end_, begin + kSegmentsPerJob * kSegmentBytes);
+        segment_sieve sieve(primes_, pattern_, begin);
+        for (std::uint64_t first = begin; first < stop; first += kSegmentBytes) {
+            const auto bytes = static_cast<size_t>(std::min<std::uint64_t>(kSegmentBytes, stop - first));
+            std::uint8_t* seg = sieve.run(first, bytes);
+            if (first == 0) {
+                seg[0] &= static_cast<std::uint8_t>(~kBits.bit[1]);
+            }
+            if (first == first_) {
+                seg[0] &= static_cast<std::uint8_t>(~below_mask(a_ % 30));
+            }
+            if (first + bytes == end_) {
+                seg[bytes - 1] &= static_cast<std::uint8_t>(below_mask(b_ % 30 + 1));
+            }
+            visit(seg, first, bytes);
+        }
+    }
+
+private:
+    // Bits for the residues below r.
+    static std::uint8_t below_mask(std::uint64_t r)
+    {
+        std::uint8_t mask = 0;
+        for (std::uint64_t k = 0; k < 8 && kResidues[k] < r; ++k) {
+            mask = static_cast<std::uint8_t>(mask | (1U << k));
+        }
+        return mask;
+    }
+
+    std::uint64_t a_;
+    std::uint64_t b_;
+    std::uint64_t first_;
+    std::uint64_t end_;
+    std::vector<std::uint32_t> primes_;
+    std::vector<std::uint8_t> pattern_;
+};
+
+std::uint64_t popcount(const std::uint8_t* p, size_t n)
+{
+    std::uint64_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, p + i, sizeof(word));
+        count += static_cast<std::uint64_t>(__builtin_popcountll(word));
+    }
+    for (; i < n; ++i) {
+        count += static_cast<std::uint64_t>(__builtin_popcount(p[i]));
+    }
+    return count;
+}
+
+void append_primes(std::string& out, const std::uint8_t* seg, std::uint64_t first, size_t bytes)
+{
+    char buf[kMaxIntChars];
+    for (size_t i = 0; i < bytes; ++i) {
+        for (unsigned bits = seg[i]; bits != 0; bits &= bits - 1) {
+            const std::uint64_t n = 30 * (first + i) + kResidues[__builtin_ctz(bits)];
+            char* end = format_u64(n, buf);
+            *end++ = '\n';
+            out.append(buf, static_cast<size_t>(end - buf));
+        }
+    }
+}
+
+std::unique_ptr<worker_pool> make_pool(unsigned threads, size_t jobs)
+{
+    if (threads <= 1 || jobs <= 1) {
+        return nullptr;
+    }
+    return std::make_unique<worker_pool>(threads);
+}
+
+} // namespace
+
+std::uint64_t count_primes(std::uint64_t a, std::uint64_t b, unsigned threads)
+{
+    std::uint64_t count = 0;
+    for (const std::uint64_t p : kWheelPrimes) {
+        count += a <= p && p <= b ? 1 : 0;
+    }
+    if (b < kFirstSievingPrime) {
+        return count;
+    }
+
+    const range_sieve sieve(a, b);
+    std::vector<std::uint64_t> counts(sieve.jobs());
+    const auto job = [&](size_t j) {
+        sieve.run(j, [&](const std::uint8_t* seg, std::uint64_t, size_t bytes) { counts[j] += popcount(seg, bytes); });
+    };
+    if (const std::unique_ptr<worker_pool> pool = make_pool(threads, counts.size())) {
+        pool->run(counts.size(), job);
+    } else {
+        for (size_t j = 0; j < counts.size(); ++j) {
+            job(j);
+        }
+    }
+    for (const std::uint64_t c : counts) {
+        count += c;
+    }
+    return count;
+}
+
+bool write_primes(std::uint64_t a, std::uint64_t b, unsigned threads, out_buffer& out)
+{
+    for (const std::uint64_t p : kWheelPrimes) {
+        if (a <= p && p <= b) {
+            out.put_u64(p);
+            out.put('\n');
+        }
+    }
+    if (b < kFirstSievingPrime) {
+        return out.good();
+    }
+
+    const range_sieve sieve(a, b);
+    const size_t jobs = sieve.jobs();
+    const std::unique_ptr<worker_pool> pool = make_pool(threads, jobs);
+    std::vector<std::string> texts(pool ? pool->size() * kJobsPerThread : 1);
+    for (size_t base = 0; base < jobs && out.good(); base += texts.size()) {
+        const size_t n = std::min(texts.size(), jobs - base);
+        const auto job = [&](size_t i) {
+            texts[i].clear();
+            sieve.run(base + i, [&](const std::uint8_t* seg, std::uint64_t first, size_t bytes) {
+                append_primes(texts[i], seg, first, bytes);
+            });
+        };
+        if (pool) {
+            pool->run(n, job);
+        } else {
+            job(0);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            out.write(texts[i].data(), texts[i].size());
+        }
+    }
+    return out.good();
+}
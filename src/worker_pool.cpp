@@ -0,0 +1,156 @@
+#include <worker_pool.h>
+
+#include <chrono>
+
+namespace {
+
+constexpr std::uint64_t kHalfMask = 0xffffffffULL;
+
+std::uint64_t pack(std::uint64_t head, std::uint64_t tail)
+{
+    return head | (tail << 32);
+}
+
+std::uint64_t head_of(std::uint64_t range)
+{
+    return range & kHalfMask;
+}
+
+std::uint64_t tail_of(std::uint64_t range)
+{
+    return range >> 32;
+}
+
+} // namespace
+
+worker_pool::worker_pool(unsigned threads)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+    workers_ = std::make_unique<worker[]>(threads);
+    threads_.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i] { loop(i); });
+    }
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    for (std::thread& t : threads_) {
+        t.join();
+    }
+}
+
+void worker_pool::run(size_t jobs, const std::function<void(size_t)>& job)
+{
+    if (jobs == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_);
+    const size_t n = size();
+    for (size_t w = 0; w < n; ++w) {
+        workers_[w].range.store(pack(jobs * w / n, jobs * (w + 1) / n), std::memory_order_relaxed);
+    }
+    job_ = &job;
+    busy_ = size();
+    ++generation_;
+    start_.notify_all();
+    done_.wait(lock, [this] { return busy_ == 0; });
+    job_ = nullptr;
+}
+
+std::vector<worker_stats> worker_pool::stats() const
+{
+    std::vector<worker_stats> out(size());
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = workers_[i].stats;
+    }
+    return out;
+}
+
+bool worker_pool::pop(worker& w, size_t* job)
+{
+    std::uint64_t range = w.range.load(std::memory_order_relaxed);
+    while (head_of(range) < tail_of(range)) {
+        const std::uint64_t next = pack(head_of(range) + 1, tail_of(range));
+        if (w.range.compare_exchange_weak(range, next, std::memory_order_relaxed)) {
+            *job = static_cast<size_t>(head_of(range));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool worker_pool::steal(worker& w, size_t* job)
+{
+    std::uint64_t range = w.range.load(std::memory_order_relaxed);
+    while (head_of(range) < tail_of(range)) {
+        const std::uint64_t next = pack(head_of(range), tail_of(range) - 1);
+        if (w.range.compare_exchange_weak(range, next, std::memory_order_relaxed)) {
+            *job = static_cast<size_t>(tail_of(range) - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void worker_pool::loop(unsigned id)
+{
+    using clock = std::chrono::steady_clock;
+
+    worker& self = workers_[id];
+    std::uint64_t seen = 0;
+    for (;;) {
+        const std::function<void(size_t)>* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            start_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+            job = job_;
+        }
+
+        const clock::time_point started = clock::now();
+        const unsigned n = size();
+        size_t index = 0;
+        for (;;) {
+            if (pop(self, &index)) {
+                (*job)(index);
+                ++self.stats.executed;
+                continue;
+            }
+
+            // Own deque is empty: walk the others, starting after ourselves so
+            // thieves spread out over victims.
+            bool found = false;
+            for (unsigned k = 1; k < n && !found; ++k) {
+                found = steal(workers_[(id + k) % n], &index);
+                if (!found) {
+                    ++self.stats.failed_steals;
+                }
+            }
+            if (!found) {
+                break;
+            }
+            (*job)(index);
+            ++self.stats.executed;
+            ++self.stats.stolen;
+        }
+        self.stats.busy_ns += static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - started).count());
+
+        std::lock_guard<std::mutex> lock(m_);
+        if (--busy_ == 0) {
+            done_.notify_one();
+        }
+    }
+}